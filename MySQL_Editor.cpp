@@ -18,11 +18,1310 @@
 #include "MySQL_Editor.h"
 
 #include <QApplication>
+#include <QListView>
 #include <QtGui>
+#include <QtConcurrent/QtConcurrentMap>
+#include <QtConcurrent/QtConcurrentRun>
+
+#include <algorithm>
+
+#if defined(MYSQL_EDITOR_SIMD_SCAN)
+#include <immintrin.h>
+#endif
+
+// Counts one call of an instrumented operation and adds the time it ...
+// ... took when going out of scope, whichever way it returns
+class MySQL_Counter_Scope {
+public:
+    MySQL_Counter_Scope ( qint64 &calls,
+                          qint64 &nsecs ) : Nsecs ( nsecs ) {
+        calls += 1;
+        Timer.start();
+    }
+
+    ~MySQL_Counter_Scope ( ) {
+        Nsecs += Timer.nsecsElapsed();
+    }
+
+private:
+    qint64 &Nsecs;
+    QElapsedTimer Timer;
+};
+
+// Records a trace event spanning its lifetime, if tracing is enabled
+class MySQL_Trace_Scope {
+public:
+    MySQL_Trace_Scope ( MySQL_Editor_Trace *trace,
+                        const char *name ) : Trace ( (trace and trace->isEnabled()) ? trace : 0 ),
+                                             Name ( name ),
+                                             Start_Nsecs ( Trace ? Trace->now() : 0 ) {
+    }
+
+    ~MySQL_Trace_Scope ( ) {
+        if (Trace) Trace->record(Name, Start_Nsecs, Trace->now());
+    }
+
+private:
+    MySQL_Editor_Trace *Trace;
+    const char *Name;
+    qint64 Start_Nsecs;
+};
+
+MySQL_Editor_Trace::MySQL_Editor_Trace ( ) : Capacity ( 0 ),
+                                             Next_Event ( 0 ),
+                                             Enabled ( false ) {
+    Clock.start();
+}
+
+void
+MySQL_Editor_Trace::setEnabled ( bool enable,
+                                 int capacity ) {
+    uint new_capacity = 1;
+    while (new_capacity < uint(qMax(1, capacity))) new_capacity *= 2;
+    if (enable and (not (new_capacity == Capacity))) {
+        Events.reset(new Event[new_capacity]);
+        Capacity = new_capacity;
+        Next_Event.storeRelease(0);
+    }
+    Enabled = enable;
+}
+
+bool
+MySQL_Editor_Trace::isEnabled ( ) const {
+    return Enabled;
+}
+
+qint64
+MySQL_Editor_Trace::now ( ) const {
+    return Clock.nsecsElapsed();
+}
+
+void
+MySQL_Editor_Trace::record ( const char *name,
+                             qint64 start_nsecs,
+                             qint64 end_nsecs ) {
+    if (not Enabled) return;
+    // Claim a slot, then publish it by its sequence, which the export ...
+    // ... checks before and after copying so it skips torn events
+    uint event_number = uint(Next_Event.fetchAndAddRelaxed(1));
+    Event &event = Events[event_number & (Capacity - 1)];
+    event.Sequence.storeRelease(0);
+    event.Name = name;
+    event.Start_Nsecs = start_nsecs;
+    event.Duration_Nsecs = end_nsecs - start_nsecs;
+    event.Thread_Id = reinterpret_cast<quintptr>(QThread::currentThreadId());
+    event.Sequence.storeRelease(int(event_number + 1));
+}
+
+void
+MySQL_Editor_Trace::clear ( ) {
+    for (uint event_idx = 0; event_idx < Capacity; event_idx += 1)
+        Events[event_idx].Sequence.storeRelease(0);
+    Next_Event.storeRelease(0);
+}
+
+QByteArray
+MySQL_Editor_Trace::toChromeTraceJson ( ) const {
+    // Complete ("X") events, times in microseconds, oldest first
+    QByteArray json("{\"traceEvents\":[");
+    uint next_event = uint(Next_Event.loadAcquire());
+    uint first_event = ((next_event > Capacity) ? (next_event - Capacity) : 0);
+    QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+    bool first_written = true;
+    for (uint event_number = first_event; not (event_number == next_event); event_number += 1) {
+        const Event &event = Events[event_number & (Capacity - 1)];
+        int sequence = event.Sequence.loadAcquire();
+        if (not (sequence == int(event_number + 1))) continue;
+        const char *name = event.Name;
+        qint64 start_nsecs = event.Start_Nsecs;
+        qint64 duration_nsecs = event.Duration_Nsecs;
+        quintptr thread_id = event.Thread_Id;
+        if (not (event.Sequence.loadAcquire() == sequence)) continue;
+
+        if (not first_written) json += ',';
+        first_written = false;
+        json += "{\"name\":\"";
+        json += name;
+        json += "\",\"cat\":\"editor\",\"ph\":\"X\",\"ts\":";
+        json += QByteArray::number(double(start_nsecs) / 1000.0, 'f', 3);
+        json += ",\"dur\":";
+        json += QByteArray::number(double(duration_nsecs) / 1000.0, 'f', 3);
+        json += ",\"pid\":";
+        json += pid;
+        json += ",\"tid\":";
+        json += QByteArray::number(qulonglong(thread_id));
+        json += '}';
+    }
+    json += "],\"displayTimeUnit\":\"ms\"}";
+    return json;
+}
+
+MySQL_Keyword_Table::MySQL_Keyword_Table ( ) : Entry_Count ( 0 ),
+                                               Max_Word_Length ( 0 ) {
+    Entries.resize(256);
+}
+
+uint
+MySQL_Keyword_Table::hashWord ( const QChar *word,
+                                int length ) {
+    // FNV-1a over ASCII upper case, no temporary QString required
+    uint hash = 2166136261u;
+    for (int ch_idx = 0; ch_idx < length; ch_idx += 1) {
+        ushort ch = word[ch_idx].unicode();
+        if ((ch >= 'a') and (ch <= 'z')) ch -= ('a' - 'A');
+        hash = (hash ^ ch) * 16777619u;
+    }
+    return hash;
+}
+
+void
+MySQL_Keyword_Table::rehash ( int new_size ) {
+    QVector<Entry> old_entries = Entries;
+    Entries = QVector<Entry>(new_size);
+    int mask = new_size - 1;
+    foreach (const Entry &entry, old_entries) {
+        if (entry.word.isEmpty()) continue;
+        QString word = QString::fromLatin1(entry.word);
+        int entry_idx = hashWord(word.constData(), word.length()) & mask;
+        while (not Entries[entry_idx].word.isEmpty()) entry_idx = (entry_idx + 1) & mask;
+        Entries[entry_idx] = entry;
+    }
+}
+
+void
+MySQL_Keyword_Table::insert ( const QStringList &words,
+                              int word_class ) {
+    foreach (const QString &word, words) {
+        if (word.isEmpty()) continue;
+        // Keep load factor at or below one half so that probe sequences stay short
+        if (((Entry_Count + 1) * 2) > Entries.count()) rehash(Entries.count() * 2);
+
+        // Words are kept as given, those differing in case only share a ...
+        // ... probe sequence
+        QByteArray latin1_word = word.toLatin1();
+        int mask = Entries.count() - 1;
+        int entry_idx = hashWord(word.constData(), word.length()) & mask;
+        while (not Entries[entry_idx].word.isEmpty()) {
+            if (Entries[entry_idx].word == latin1_word) break;
+            entry_idx = (entry_idx + 1) & mask;
+        }
+        if (Entries[entry_idx].word.isEmpty()) {
+            Entries[entry_idx].word = latin1_word;
+            Entries[entry_idx].word_class = No_Class;
+            Entry_Count += 1;
+        }
+        Entries[entry_idx].word_class |= word_class;
+        Max_Word_Length = qMax(Max_Word_Length, word.length());
+    }
+}
+
+int
+MySQL_Keyword_Table::classify ( const QChar *word,
+                                int length,
+                                Qt::CaseSensitivity case_sensitivity ) const {
+    if ((length <= 0) or (length > Max_Word_Length)) return No_Class;
+
+    bool fold_case = (case_sensitivity == Qt::CaseInsensitive);
+    int word_class = No_Class;
+    int mask = Entries.count() - 1;
+    int entry_idx = hashWord(word, length) & mask;
+    while (not Entries.at(entry_idx).word.isEmpty()) {
+        const QByteArray &entry_word = Entries.at(entry_idx).word;
+        if (entry_word.length() == length) {
+            int ch_idx = 0;
+            for (; ch_idx < length; ch_idx += 1) {
+                ushort ch = word[ch_idx].unicode();
+                ushort entry_ch = ushort(uchar(entry_word.at(ch_idx)));
+                if (fold_case) {
+                    if ((ch >= 'a') and (ch <= 'z')) ch -= ('a' - 'A');
+                    if ((entry_ch >= 'a') and (entry_ch <= 'z')) entry_ch -= ('a' - 'A');
+                }
+                if (not (ch == entry_ch)) break;
+            }
+            if (ch_idx == length) word_class |= Entries.at(entry_idx).word_class;
+        }
+        entry_idx = (entry_idx + 1) & mask;
+    }
+    return word_class;
+}
+
+int
+MySQL_Keyword_Table::classify ( const QString &word,
+                                Qt::CaseSensitivity case_sensitivity ) const {
+    return classify(word.constData(), word.length(), case_sensitivity);
+}
+
+MySQL_Completion_Model::MySQL_Completion_Model ( QObject *parent ) : QAbstractListModel ( parent ),
+                                                                     Words_Sorted ( true ),
+                                                                     First_Row ( 0 ),
+                                                                     Row_Count ( 0 ) {
+}
+
+void
+MySQL_Completion_Model::setWords ( const QStringList &words,
+                                   bool sorted ) {
+    // Sorted lists must be sorted by QStringList::sort(Qt::CaseInsensitive)
+    beginResetModel();
+    Words = words;
+    Words_Sorted = sorted;
+    Prefix.clear();
+    computeRows();
+    endResetModel();
+}
+
+void
+MySQL_Completion_Model::setPrefix ( const QString &prefix ) {
+    if (prefix == Prefix) return;
+
+    beginResetModel();
+    Prefix = prefix;
+    computeRows();
+    endResetModel();
+}
+
+void
+MySQL_Completion_Model::computeRows ( ) {
+    Filtered_Rows.clear();
+    First_Row = 0;
+    Row_Count = Words.count();
+    if (Prefix.isEmpty()) return;
+
+    if (not Words_Sorted) {
+        for (int word_idx = 0; word_idx < Words.count(); word_idx += 1) {
+            if (Words.at(word_idx).startsWith(Prefix, Qt::CaseInsensitive)) Filtered_Rows.append(word_idx);
+        }
+        Row_Count = Filtered_Rows.count();
+        return;
+    }
+
+    // First word not less than the prefix ...
+    int low = 0;
+    int high = Words.count();
+    while (low < high) {
+        int middle = low + ((high - low) / 2);
+        if (QString::compare(Words.at(middle), Prefix, Qt::CaseInsensitive) < 0) low = middle + 1;
+        else high = middle;
+    }
+    First_Row = low;
+    // ... and the first word past it that does not begin with the prefix
+    high = Words.count();
+    while (low < high) {
+        int middle = low + ((high - low) / 2);
+        if (Words.at(middle).leftRef(Prefix.length()).compare(Prefix, Qt::CaseInsensitive) <= 0) low = middle + 1;
+        else high = middle;
+    }
+    Row_Count = low - First_Row;
+}
+
+int
+MySQL_Completion_Model::rowCount ( const QModelIndex &parent ) const {
+    return parent.isValid() ? 0 : Row_Count;
+}
+
+QVariant
+MySQL_Completion_Model::data ( const QModelIndex &index,
+                               int role ) const {
+    if ((not index.isValid()) or (index.row() >= Row_Count)) return QVariant();
+    if (not ((role == Qt::DisplayRole) or (role == Qt::EditRole))) return QVariant();
+
+    int word_idx = Filtered_Rows.isEmpty() ? (First_Row + index.row()) : Filtered_Rows.at(index.row());
+    return Words.at(word_idx);
+}
+
+#define Max_Fuzzy_Completions 500
+
+static int
+Fuzzy_Completion_Score ( const QString &word,
+                         const QString &folded_pattern ) {
+    // Greedy case-insensitive subsequence match, e.g. 'ordcust' in ...
+    // ... 'order_customer_id'. Matches at word starts and runs of consecutive ...
+    // ... matches score higher, -1 if pattern is not a subsequence of word.
+    int pattern_idx = 0;
+    int score = 0;
+    int run_length = 0;
+    int last_match_idx = -2;
+    for (int ch_idx = 0; (ch_idx < word.length()) and (pattern_idx < folded_pattern.length()); ch_idx += 1) {
+        QChar ch = word.at(ch_idx);
+        if (not (ch.toCaseFolded() == folded_pattern.at(pattern_idx))) continue;
+
+        int bonus = 1;
+        if (ch_idx == 0) {
+            bonus += 8;
+        }
+        else {
+            QChar prev_ch = word.at(ch_idx - 1);
+            if ((prev_ch == '_') or (prev_ch == '.') or (prev_ch == '$') or
+                (prev_ch.isLower() and ch.isUpper())) bonus += 6;
+        }
+        if (last_match_idx == (ch_idx - 1)) {
+            run_length += 1;
+            bonus += 4 * run_length;
+        }
+        else {
+            run_length = 0;
+        }
+        score += bonus;
+        last_match_idx = ch_idx;
+        pattern_idx += 1;
+    }
+    if (pattern_idx < folded_pattern.length()) return -1;
+
+    // Among equal matches prefer the shorter word
+    return (score * 64) - qMin(word.length(), 63);
+}
+
+static bool
+Fuzzy_Completion_Less_Than ( const QPair<int, int> &lhs,
+                             const QPair<int, int> &rhs ) {
+    // Higher score first, then word list (alphabetical) order
+    if (not (lhs.first == rhs.first)) return lhs.first > rhs.first;
+    return lhs.second < rhs.second;
+}
+
+static QStringList
+Rank_Fuzzy_Completions ( QStringList words,
+                         QString pattern,
+                         QSharedPointer<QAtomicInt> generation,
+                         int query_generation ) {
+    // Runs on a worker thread, words is an implicitly shared snapshot
+    QString folded_pattern = pattern.toCaseFolded();
+    QVector<QPair<int, int> > matches;
+    for (int word_idx = 0; word_idx < words.count(); word_idx += 1) {
+        if (((word_idx % 4096) == 0) and
+            (not (generation->loadAcquire() == query_generation))) return QStringList();
+
+        int score = Fuzzy_Completion_Score(words.at(word_idx), folded_pattern);
+        if (score >= 0) matches.append(qMakePair(score, word_idx));
+    }
+
+    int match_count = qMin(matches.count(), Max_Fuzzy_Completions);
+    std::partial_sort(matches.begin(), matches.begin() + match_count, matches.end(), Fuzzy_Completion_Less_Than);
+
+    QStringList ranked_words;
+    ranked_words.reserve(match_count);
+    for (int match_idx = 0; match_idx < match_count; match_idx += 1) {
+        ranked_words << words.at(matches.at(match_idx).second);
+    }
+    return ranked_words;
+}
+
+MySQL_Schema_Provider::MySQL_Schema_Provider ( QObject *parent ) : QObject ( parent ) {
+}
+
+MySQL_Static_Schema_Provider::MySQL_Static_Schema_Provider ( QObject *parent ) : MySQL_Schema_Provider ( parent ) {
+}
+
+void
+MySQL_Static_Schema_Provider::setContextIdentifiers ( const QHash <QString, QStringList> &context_identifiers ) {
+    Context_Identifiers = context_identifiers;
+}
+
+void
+MySQL_Static_Schema_Provider::requestContextIdentifiers ( const QString &context_identifier ) {
+    // Answer from the event loop, just as a real (remote) provider would
+    if (Pending_Requests.isEmpty()) QTimer::singleShot(0, this, SLOT(answerRequests()));
+    Pending_Requests << context_identifier;
+}
+
+void
+MySQL_Static_Schema_Provider::answerRequests ( ) {
+    QStringList requests = Pending_Requests;
+    Pending_Requests.clear();
+    foreach (const QString &context_identifier, requests) {
+        emit contextIdentifiersReady(context_identifier, Context_Identifiers.value(context_identifier));
+    }
+}
+
+static QString
+Intern_String ( QSet<QString> &intern_pool,
+                const QString &string ) {
+    QSet<QString>::const_iterator interned = intern_pool.constFind(string);
+    if (interned == intern_pool.constEnd()) {
+        intern_pool.insert(string);
+        return string;
+    }
+    return *interned;
+}
+
+MySQL_Schema_Catalog::MySQL_Schema_Catalog ( const QStringList &identifiers,
+                                             const QHash <QString, QStringList> &context_identifiers ) {
+    QSet<QString> intern_pool;
+
+    Identifiers.reserve(identifiers.count());
+    foreach (const QString &identifier, identifiers) Identifiers << Intern_String(intern_pool, identifier);
+    Identifiers.sort(Qt::CaseInsensitive);
+
+    QHash <QString, QStringList>::const_iterator context = context_identifiers.constBegin();
+    for (; not (context == context_identifiers.constEnd()); ++context) {
+        QStringList interned_identifiers;
+        interned_identifiers.reserve(context.value().count());
+        foreach (const QString &identifier, context.value()) {
+            interned_identifiers << Intern_String(intern_pool, identifier);
+        }
+        Context_Identifiers.insert(Intern_String(intern_pool, context.key()), interned_identifiers);
+    }
+}
+
+bool
+MySQL_Schema_Catalog::hasContext ( const QString &context_identifier ) const {
+    return Context_Identifiers.contains(context_identifier);
+}
+
+QStringList
+MySQL_Schema_Catalog::contextIdentifiers ( const QString &context_identifier ) const {
+    return Context_Identifiers.value(context_identifier);
+}
+
+QStringList
+MySQL_Schema_Catalog::completionWords ( const QStringList &sorted_keywords ) const {
+    if (sorted_keywords.isEmpty()) return Identifiers;
+
+    QMutexLocker locker(&Completion_Words_Mutex);
+    if (Completion_Words.isEmpty() or (not (Completion_Keywords == sorted_keywords))) {
+        // Linear merge of two case-insensitively sorted lists
+        QStringList words;
+        words.reserve(Identifiers.count() + sorted_keywords.count());
+        int identifier_idx = 0;
+        int keyword_idx = 0;
+        while ((identifier_idx < Identifiers.count()) or (keyword_idx < sorted_keywords.count())) {
+            if ((keyword_idx == sorted_keywords.count()) or
+                ((identifier_idx < Identifiers.count()) and
+                 (QString::compare(Identifiers.at(identifier_idx), sorted_keywords.at(keyword_idx), Qt::CaseInsensitive) <= 0))) {
+                words << Identifiers.at(identifier_idx++);
+            }
+            else {
+                words << sorted_keywords.at(keyword_idx++);
+            }
+        }
+        Completion_Keywords = sorted_keywords;
+        Completion_Words = words;
+    }
+    return Completion_Words;
+}
+
+MySQL_Shared_Schema_Catalog::MySQL_Shared_Schema_Catalog ( QObject *parent ) : QObject ( parent ) {
+}
+
+QSharedPointer <const MySQL_Schema_Catalog>
+MySQL_Shared_Schema_Catalog::catalog ( ) const {
+    QMutexLocker locker(&Catalog_Mutex);
+    return Catalog;
+}
+
+void
+MySQL_Shared_Schema_Catalog::publish ( QSharedPointer <const MySQL_Schema_Catalog> catalog ) {
+    {
+        QMutexLocker locker(&Catalog_Mutex);
+        Catalog.swap(catalog);
+    }
+    // The previous catalog (now in catalog) is released here, or by the last ...
+    // ... editor still holding it
+    emit catalogChanged();
+}
+
+#define Default_Context_Identifier_Cache_Bytes (32 * 1024 * 1024)
+
+static int
+Context_Identifier_Cost ( const QStringList &identifiers ) {
+    // Approximate bytes held, QString header plus UTF-16 payload
+    int cost = 64;
+    foreach (const QString &identifier, identifiers) cost += 32 + (2 * identifier.size());
+    return cost;
+}
+
+MySQLBlockData::MySQLBlockData ( ) : Long_Line ( false ),
+                                     Window_First ( 0 ),
+                                     Window_Last ( -1 ),
+                                     Tree ( 0 ),
+                                     Tree_Parent ( 0 ),
+                                     Tree_Left ( 0 ),
+                                     Tree_Right ( 0 ),
+                                     Tree_Priority ( 0 ),
+                                     Tree_Size ( 1 ),
+                                     Subtree_Statements ( 0 ),
+                                     Fold_End_Block ( -1 ),
+                                     Fold_Generation ( 0 ) {
+    for (uint pair = 0; pair < MySQL_Bracket_Pair_Count; pair += 1) {
+        Block_Summary[pair].net = 0;
+        Block_Summary[pair].min_prefix = 0;
+        Subtree_Summary[pair] = Block_Summary[pair];
+    }
+}
+
+MySQLBlockData::~MySQLBlockData ( ) {
+    // The document deletes user data along with its block
+    if (Tree) Tree->remove(this);
+}
+
+MySQL_Bracket_Tree::MySQL_Bracket_Tree ( ) : Root ( 0 ),
+                                             Random_State ( 0x9E3779B9u ),
+                                             Generation ( 0 ) {
+}
+
+MySQL_Bracket_Tree::~MySQL_Bracket_Tree ( ) {
+    // Block user data may outlive the highlighter, detach every node
+    QVector<MySQLBlockData*> pending_nodes;
+    if (Root) pending_nodes.append(Root);
+    while (not pending_nodes.isEmpty()) {
+        MySQLBlockData *node = pending_nodes.takeLast();
+        if (node->Tree_Left) pending_nodes.append(node->Tree_Left);
+        if (node->Tree_Right) pending_nodes.append(node->Tree_Right);
+        node->Tree = 0;
+        node->Tree_Parent = 0;
+        node->Tree_Left = 0;
+        node->Tree_Right = 0;
+    }
+    Root = 0;
+}
+
+static inline MySQL_Bracket_Summary
+Combine_Bracket_Summary ( const MySQL_Bracket_Summary &left,
+                          const MySQL_Bracket_Summary &right ) {
+    MySQL_Bracket_Summary combined;
+    combined.net = left.net + right.net;
+    combined.min_prefix = qMin(left.min_prefix, left.net + right.min_prefix);
+    return combined;
+}
+
+static inline int
+Max_Bracket_Suffix ( const MySQL_Bracket_Summary &summary ) {
+    // Highest depth of any trailing run, derived from the lowest prefix
+    return summary.net - summary.min_prefix;
+}
+
+void
+MySQL_Bracket_Tree::pull ( MySQLBlockData *node ) {
+    node->Tree_Size = 1;
+    if (node->Tree_Left) node->Tree_Size += node->Tree_Left->Tree_Size;
+    if (node->Tree_Right) node->Tree_Size += node->Tree_Right->Tree_Size;
+    node->Subtree_Statements = node->Statement_Ends.count();
+    if (node->Tree_Left) node->Subtree_Statements += node->Tree_Left->Subtree_Statements;
+    if (node->Tree_Right) node->Subtree_Statements += node->Tree_Right->Subtree_Statements;
+    for (uint pair = 0; pair < MySQL_Bracket_Pair_Count; pair += 1) {
+        MySQL_Bracket_Summary summary = node->Block_Summary[pair];
+        if (node->Tree_Left)
+            summary = Combine_Bracket_Summary(node->Tree_Left->Subtree_Summary[pair], summary);
+        if (node->Tree_Right)
+            summary = Combine_Bracket_Summary(summary, node->Tree_Right->Subtree_Summary[pair]);
+        node->Subtree_Summary[pair] = summary;
+    }
+}
+
+void
+MySQL_Bracket_Tree::rotateUp ( MySQLBlockData *node ) {
+    MySQLBlockData *parent = node->Tree_Parent;
+    MySQLBlockData *grandparent = parent->Tree_Parent;
+    if (parent->Tree_Left == node) {
+        parent->Tree_Left = node->Tree_Right;
+        if (node->Tree_Right) node->Tree_Right->Tree_Parent = parent;
+        node->Tree_Right = parent;
+    }
+    else {
+        parent->Tree_Right = node->Tree_Left;
+        if (node->Tree_Left) node->Tree_Left->Tree_Parent = parent;
+        node->Tree_Left = parent;
+    }
+    parent->Tree_Parent = node;
+    node->Tree_Parent = grandparent;
+    if (not grandparent) Root = node;
+    else if (grandparent->Tree_Left == parent) grandparent->Tree_Left = node;
+    else grandparent->Tree_Right = node;
+    pull(parent);
+    pull(node);
+}
+
+void
+MySQL_Bracket_Tree::insertAfter ( MySQLBlockData *node,
+                                  MySQLBlockData *previous ) {
+    // previous == 0 inserts at the start of the document
+    Generation += 1;
+    Random_State = Random_State * 1664525u + 1013904223u;
+    node->Tree = this;
+    node->Tree_Priority = Random_State;
+    node->Tree_Parent = 0;
+    node->Tree_Left = 0;
+    node->Tree_Right = 0;
+    pull(node);
+
+    if (not Root) {
+        Root = node;
+        return;
+    }
+
+    MySQLBlockData *attach_node;
+    if (previous and (not previous->Tree_Right)) {
+        attach_node = previous;
+        attach_node->Tree_Right = node;
+    }
+    else {
+        attach_node = (previous ? previous->Tree_Right : Root);
+        while (attach_node->Tree_Left) attach_node = attach_node->Tree_Left;
+        attach_node->Tree_Left = node;
+    }
+    node->Tree_Parent = attach_node;
+    for (MySQLBlockData *ancestor = attach_node; ancestor; ancestor = ancestor->Tree_Parent)
+        pull(ancestor);
+
+    while (node->Tree_Parent and (node->Tree_Priority > node->Tree_Parent->Tree_Priority))
+        rotateUp(node);
+}
+
+void
+MySQL_Bracket_Tree::remove ( MySQLBlockData *node ) {
+    Generation += 1;
+    // Rotate node down to a leaf, then detach it
+    while (node->Tree_Left or node->Tree_Right) {
+        MySQLBlockData *child = node->Tree_Left;
+        if ((not child) or
+            (node->Tree_Right and (node->Tree_Right->Tree_Priority > child->Tree_Priority)))
+            child = node->Tree_Right;
+        rotateUp(child);
+    }
+    MySQLBlockData *parent = node->Tree_Parent;
+    if (not parent) Root = 0;
+    else if (parent->Tree_Left == node) parent->Tree_Left = 0;
+    else parent->Tree_Right = 0;
+    for (MySQLBlockData *ancestor = parent; ancestor; ancestor = ancestor->Tree_Parent)
+        pull(ancestor);
+    node->Tree = 0;
+    node->Tree_Parent = 0;
+}
+
+void
+MySQL_Bracket_Tree::update ( MySQLBlockData *node,
+                             bool summarize_block ) {
+    // Without summarize_block, the caller has set Block_Summary, as for ...
+    // ... long lines whose bracket index covers their window only
+    if (summarize_block) {
+        MySQL_Bracket_Summary block_summary[MySQL_Bracket_Pair_Count];
+        for (uint pair = 0; pair < MySQL_Bracket_Pair_Count; pair += 1) {
+            block_summary[pair].net = 0;
+            block_summary[pair].min_prefix = 0;
+        }
+        for (int bracket_idx = 0; bracket_idx < node->bracketCharacters.length(); bracket_idx += 1)
+            addBracket(block_summary, node->bracketCharacters.at(bracket_idx));
+        for (uint pair = 0; pair < MySQL_Bracket_Pair_Count; pair += 1) {
+            if ((block_summary[pair].net == node->Block_Summary[pair].net) and
+                (block_summary[pair].min_prefix == node->Block_Summary[pair].min_prefix)) continue;
+            node->Block_Summary[pair] = block_summary[pair];
+            Generation += 1;
+        }
+    }
+    else {
+        Generation += 1;
+    }
+    for (MySQLBlockData *ancestor = node; ancestor; ancestor = ancestor->Tree_Parent)
+        pull(ancestor);
+}
+
+void
+MySQL_Bracket_Tree::addBracket ( MySQL_Bracket_Summary *summaries,
+                                 QChar bracket ) {
+    // Called per bracket of multi-megabyte lines, so no QString here
+    static const char bracket_list[] = MySQL_Bracket_List;
+    for (uint list_idx = 0; list_idx < (2 * MySQL_Bracket_Pair_Count); list_idx += 1) {
+        if (not (bracket == QLatin1Char(bracket_list[list_idx]))) continue;
+        MySQL_Bracket_Summary &summary = summaries[list_idx / 2];
+        summary.net += (((list_idx % 2) == 0) ? 1 : -1);
+        summary.min_prefix = qMin(summary.min_prefix, summary.net);
+        return;
+    }
+}
+
+uint
+MySQL_Bracket_Tree::generation ( ) const {
+    return Generation;
+}
+
+int
+MySQL_Bracket_Tree::blockNumber ( const MySQLBlockData *node ) const {
+    // Every block has a node, so a node's rank is its block number
+    int block_number = (node->Tree_Left ? node->Tree_Left->Tree_Size : 0);
+    for (; node->Tree_Parent; node = node->Tree_Parent) {
+        if (node->Tree_Parent->Tree_Right == node)
+            block_number += 1 + (node->Tree_Parent->Tree_Left ? node->Tree_Parent->Tree_Left->Tree_Size : 0);
+    }
+    return block_number;
+}
+
+int
+MySQL_Bracket_Tree::statementsBefore ( const MySQLBlockData *node ) const {
+    // As blockNumber, counting statement ends instead of blocks
+    int statements = (node->Tree_Left ? node->Tree_Left->Subtree_Statements : 0);
+    for (; node->Tree_Parent; node = node->Tree_Parent) {
+        const MySQLBlockData *parent = node->Tree_Parent;
+        if (parent->Tree_Right == node)
+            statements += parent->Statement_Ends.count() +
+                          (parent->Tree_Left ? parent->Tree_Left->Subtree_Statements : 0);
+    }
+    return statements;
+}
+
+int
+MySQL_Bracket_Tree::statementCount ( ) const {
+    return (Root ? Root->Subtree_Statements : 0);
+}
+
+MySQLBlockData *
+MySQL_Bracket_Tree::findStatement ( int statement_idx,
+                                    int &block_statement_idx ) const {
+    MySQLBlockData *node = Root;
+    while (node) {
+        int left_statements = (node->Tree_Left ? node->Tree_Left->Subtree_Statements : 0);
+        if (statement_idx < left_statements) {
+            node = node->Tree_Left;
+            continue;
+        }
+        statement_idx -= left_statements;
+        if (statement_idx < node->Statement_Ends.count()) {
+            block_statement_idx = statement_idx;
+            return node;
+        }
+        statement_idx -= node->Statement_Ends.count();
+        node = node->Tree_Right;
+    }
+    return 0;
+}
+
+MySQLBlockData *
+MySQL_Bracket_Tree::findForward ( const MySQLBlockData *node,
+                                  int pair,
+                                  int &paren_level ) const {
+    // Finds the first block after node where the running depth, ...
+    // ... starting at paren_level, drops to zero. On success paren_level ...
+    // ... holds the depth on entry to that block.
+    MySQLBlockData *subtree = 0;
+    const MySQLBlockData *current = node;
+    if (current->Tree_Right) {
+        if ((paren_level + current->Tree_Right->Subtree_Summary[pair].min_prefix) <= 0)
+            subtree = current->Tree_Right;
+        else paren_level += current->Tree_Right->Subtree_Summary[pair].net;
+    }
+    while ((not subtree) and current->Tree_Parent) {
+        MySQLBlockData *parent = current->Tree_Parent;
+        if (parent->Tree_Left == current) {
+            if ((paren_level + parent->Block_Summary[pair].min_prefix) <= 0) return parent;
+            paren_level += parent->Block_Summary[pair].net;
+            if (parent->Tree_Right) {
+                if ((paren_level + parent->Tree_Right->Subtree_Summary[pair].min_prefix) <= 0)
+                    subtree = parent->Tree_Right;
+                else paren_level += parent->Tree_Right->Subtree_Summary[pair].net;
+            }
+        }
+        current = parent;
+    }
+
+    while (subtree) {
+        if (subtree->Tree_Left) {
+            if ((paren_level + subtree->Tree_Left->Subtree_Summary[pair].min_prefix) <= 0) {
+                subtree = subtree->Tree_Left;
+                continue;
+            }
+            paren_level += subtree->Tree_Left->Subtree_Summary[pair].net;
+        }
+        if ((paren_level + subtree->Block_Summary[pair].min_prefix) <= 0) return subtree;
+        paren_level += subtree->Block_Summary[pair].net;
+        subtree = subtree->Tree_Right;
+    }
+
+    return 0; // Unbalanced, no match
+}
+
+MySQLBlockData *
+MySQL_Bracket_Tree::findBackward ( const MySQLBlockData *node,
+                                   int pair,
+                                   int &paren_level ) const {
+    // Mirror image of findForward, paren_level counts unmatched closing brackets
+    MySQLBlockData *subtree = 0;
+    const MySQLBlockData *current = node;
+    if (current->Tree_Left) {
+        if ((paren_level - Max_Bracket_Suffix(current->Tree_Left->Subtree_Summary[pair])) <= 0)
+            subtree = current->Tree_Left;
+        else paren_level -= current->Tree_Left->Subtree_Summary[pair].net;
+    }
+    while ((not subtree) and current->Tree_Parent) {
+        MySQLBlockData *parent = current->Tree_Parent;
+        if (parent->Tree_Right == current) {
+            if ((paren_level - Max_Bracket_Suffix(parent->Block_Summary[pair])) <= 0) return parent;
+            paren_level -= parent->Block_Summary[pair].net;
+            if (parent->Tree_Left) {
+                if ((paren_level - Max_Bracket_Suffix(parent->Tree_Left->Subtree_Summary[pair])) <= 0)
+                    subtree = parent->Tree_Left;
+                else paren_level -= parent->Tree_Left->Subtree_Summary[pair].net;
+            }
+        }
+        current = parent;
+    }
+
+    while (subtree) {
+        if (subtree->Tree_Right) {
+            if ((paren_level - Max_Bracket_Suffix(subtree->Tree_Right->Subtree_Summary[pair])) <= 0) {
+                subtree = subtree->Tree_Right;
+                continue;
+            }
+            paren_level -= subtree->Tree_Right->Subtree_Summary[pair].net;
+        }
+        if ((paren_level - Max_Bracket_Suffix(subtree->Block_Summary[pair])) <= 0) return subtree;
+        paren_level -= subtree->Block_Summary[pair].net;
+        subtree = subtree->Tree_Left;
+    }
+
+    return 0; // Unbalanced, no match
+}
+
+int
+MySQL_Bracket_Tree::scanBlock ( const MySQLBlockData *node,
+                                int pair,
+                                int bracket_idx,
+                                bool search_forward,
+                                int &paren_level ) {
+    // Scans one block's brackets from bracket_idx, returns the index ...
+    // ... where paren_level reaches zero, or -1 if it never does.
+    QString bracket_list = MySQL_Bracket_List;
+    QChar open_bracket = bracket_list.at(2 * pair);
+    QChar close_bracket = bracket_list.at(2 * pair + 1);
+    while ((bracket_idx >= 0) and (bracket_idx < node->bracketCharacters.length())) {
+        QChar bracket = node->bracketCharacters.at(bracket_idx);
+        if (bracket == open_bracket) paren_level += (search_forward ? 1 : -1);
+        else if (bracket == close_bracket) paren_level += (search_forward ? -1 : 1);
+        if (paren_level == 0) return bracket_idx;
+        bracket_idx += (search_forward ? 1 : -1);
+    }
+    return -1;
+}
+
+int
+Scan_For_Characters_Scalar ( const ushort *text,
+                             int from,
+                             int to,
+                             ushort c0,
+                             ushort c1,
+                             ushort c2,
+                             ushort c3 ) {
+    for (int ch_idx = from; ch_idx < to; ch_idx += 1) {
+        ushort ch = text[ch_idx];
+        if ((ch == c0) or (ch == c1) or (ch == c2) or (ch == c3)) return ch_idx;
+    }
+    return to;
+}
+
+#if defined(MYSQL_EDITOR_SIMD_SCAN)
+__attribute__((target("sse2"))) int
+Scan_For_Characters_SSE2 ( const ushort *text,
+                           int from,
+                           int to,
+                           ushort c0,
+                           ushort c1,
+                           ushort c2,
+                           ushort c3 ) {
+    // Eight UTF-16 code units per compare
+    const __m128i v0 = _mm_set1_epi16(short(c0));
+    const __m128i v1 = _mm_set1_epi16(short(c1));
+    const __m128i v2 = _mm_set1_epi16(short(c2));
+    const __m128i v3 = _mm_set1_epi16(short(c3));
+    int ch_idx = from;
+    for (; (ch_idx + 8) <= to; ch_idx += 8) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + ch_idx));
+        __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(chunk, v0), _mm_cmpeq_epi16(chunk, v1)),
+                                     _mm_or_si128(_mm_cmpeq_epi16(chunk, v2), _mm_cmpeq_epi16(chunk, v3)));
+        int mask = _mm_movemask_epi8(found);
+        if (mask) return ch_idx + (__builtin_ctz(mask) >> 1);
+    }
+    return Scan_For_Characters_Scalar(text, ch_idx, to, c0, c1, c2, c3);
+}
+
+__attribute__((target("avx2"))) int
+Scan_For_Characters_AVX2 ( const ushort *text,
+                           int from,
+                           int to,
+                           ushort c0,
+                           ushort c1,
+                           ushort c2,
+                           ushort c3 ) {
+    // Sixteen UTF-16 code units per compare
+    const __m256i v0 = _mm256_set1_epi16(short(c0));
+    const __m256i v1 = _mm256_set1_epi16(short(c1));
+    const __m256i v2 = _mm256_set1_epi16(short(c2));
+    const __m256i v3 = _mm256_set1_epi16(short(c3));
+    int ch_idx = from;
+    for (; (ch_idx + 16) <= to; ch_idx += 16) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text + ch_idx));
+        __m256i found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(chunk, v0), _mm256_cmpeq_epi16(chunk, v1)),
+                                        _mm256_or_si256(_mm256_cmpeq_epi16(chunk, v2), _mm256_cmpeq_epi16(chunk, v3)));
+        uint mask = uint(_mm256_movemask_epi8(found));
+        if (mask) return ch_idx + (__builtin_ctz(mask) >> 1);
+    }
+    return Scan_For_Characters_SSE2(text, ch_idx, to, c0, c1, c2, c3);
+}
+#endif
+
+static Scan_Function
+Select_Scan_Function ( ) {
+#if defined(MYSQL_EDITOR_SIMD_SCAN)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Scan_For_Characters_AVX2;
+    if (__builtin_cpu_supports("sse2")) return Scan_For_Characters_SSE2;
+#endif
+    return Scan_For_Characters_Scalar;
+}
+
+static int
+Scan_For_Characters ( const ushort *text,
+                      int from,
+                      int to,
+                      ushort c0,
+                      ushort c1,
+                      ushort c2,
+                      ushort c3 ) {
+    // Index of the first of c0 .. c3 in text[from, to), or to if none. ...
+    // ... The kernel is chosen once, at runtime, from the CPU's features.
+    if (from >= to)
+        return from;
+    static const Scan_Function scan_function = Select_Scan_Function();
+    return scan_function(text, from, to, c0, c1, c2, c3);
+}
+
+#define Parallel_Lex_Min_Characters (4 * 1024 * 1024)
+#define Parallel_Lex_Min_Chunk_Characters (256 * 1024)
+
+// Lexes a contiguous run of blocks, from the entry state of the run's ...
+// ... first block, or Start for the first block of every later chunk
+struct MySQL_Lex_Chunk_Job {
+    typedef void result_type;
+
+    const QString *text;
+    const int *block_starts;
+    MySQL_Lexed_Block *blocks;
+    int entry_state;
+    const MySQL_Editor *editor;
+    QSharedPointer<QAtomicInt> generation;
+    int job_generation;
+
+    void
+    operator() ( const QPair<int, int> &chunk ) const {
+        int state = (chunk.first == 0) ? entry_state : int(MySQL_Editor_Highlighter::Start);
+        for (int block_idx = chunk.first; block_idx < chunk.second; block_idx += 1) {
+            if (((block_idx % 256) == 0) and
+                (not (generation->loadAcquire() == job_generation))) return;
+
+            // Blocks are separated by a single separator character
+            int block_length = block_starts[block_idx + 1] - block_starts[block_idx] - 1;
+            MySQL_Lexed_Block &lexed = blocks[block_idx];
+            lexed.length = block_length;
+            lexed.entry_state = state;
+            state = MySQL_Editor_Highlighter::lexText(text->mid(block_starts[block_idx], block_length),
+                                                      state, editor, lexed.tokens);
+            lexed.exit_state = state;
+        }
+    }
+};
+
+static QVector<MySQL_Lexed_Block>
+Lex_Separated_Blocks_In_Parallel ( const QString &text,
+                                   ushort separator,
+                                   int entry_state,
+                                   const MySQL_Editor *editor,
+                                   QSharedPointer<QAtomicInt> generation,
+                                   int job_generation ) {
+    // Most SQL blocks begin in Start, so every chunk is lexed concurrently ...
+    // ... as if it did. Stitching then re-lexes, in order, each chunk's ...
+    // ... leading blocks whose assumed entry state was wrong, up to the ...
+    // ... first block entered in the right state (the rest follows from it).
+    QVector<int> block_starts;
+    block_starts << 0;
+    const ushort *text_data = text.utf16();
+    int separator_idx = Scan_For_Characters(text_data, 0, text.length(), separator, separator, separator, separator);
+    while (separator_idx < text.length()) {
+        block_starts << (separator_idx + 1);
+        separator_idx = Scan_For_Characters(text_data, separator_idx + 1, text.length(),
+                                            separator, separator, separator, separator);
+    }
+    block_starts << (text.length() + 1);
+    int block_count = block_starts.count() - 1;
+
+    int chunk_characters = qMax(Parallel_Lex_Min_Chunk_Characters,
+                                text.length() / (4 * qMax(1, QThread::idealThreadCount())));
+    QList<QPair<int, int> > chunks;
+    int chunk_begin = 0;
+    for (int block_idx = 1; block_idx <= block_count; block_idx += 1) {
+        if ((block_idx == block_count) or
+            ((block_starts.at(block_idx) - block_starts.at(chunk_begin)) >= chunk_characters)) {
+            chunks << qMakePair(chunk_begin, block_idx);
+            chunk_begin = block_idx;
+        }
+    }
+
+    QVector<MySQL_Lexed_Block> blocks(block_count);
+    MySQL_Lex_Chunk_Job chunk_job;
+    chunk_job.text = &text;
+    chunk_job.block_starts = block_starts.constData();
+    chunk_job.blocks = blocks.data();
+    chunk_job.entry_state = entry_state;
+    chunk_job.editor = editor;
+    chunk_job.generation = generation;
+    chunk_job.job_generation = job_generation;
+    QtConcurrent::blockingMap(chunks, chunk_job);
+
+    int state = entry_state;
+    for (int block_idx = 0; block_idx < block_count; block_idx += 1) {
+        if (not (generation->loadAcquire() == job_generation)) return QVector<MySQL_Lexed_Block>();
+
+        MySQL_Lexed_Block &lexed = blocks[block_idx];
+        if (not (lexed.entry_state == state)) {
+            lexed.tokens.clear();
+            lexed.entry_state = state;
+            lexed.exit_state = MySQL_Editor_Highlighter::lexText(text.mid(block_starts.at(block_idx), lexed.length),
+                                                                 state, editor, lexed.tokens);
+        }
+        state = lexed.exit_state;
+    }
+    return blocks;
+}
+
+static QVector<MySQL_Lexed_Block>
+Lex_Blocks_In_Parallel ( QString text,
+                         int entry_state,
+                         const MySQL_Editor *editor,
+                         QSharedPointer<QAtomicInt> generation,
+                         int job_generation ) {
+    // Document text, blocks separated by QChar::ParagraphSeparator
+    return Lex_Separated_Blocks_In_Parallel(text, 0x2029, entry_state, editor, generation, job_generation);
+}
+
+#define Find_Min_Chunk_Characters (256 * 1024)
+#define Replace_All_Max_Edits 10000
+
+static bool
+Token_Offset_Less_Than ( int offset,
+                         const MySQL_Token &token ) {
+    return offset < token.offset;
+}
+
+static QString
+Expand_Replacement ( const QString &replacement,
+                     const QRegularExpressionMatch &match ) {
+    if (not replacement.contains('\\')) return replacement;
+
+    QString expanded;
+    expanded.reserve(replacement.length());
+    for (int ch_idx = 0; ch_idx < replacement.length(); ch_idx += 1) {
+        QChar ch = replacement.at(ch_idx);
+        if ((ch == '\\') and ((ch_idx + 1) < replacement.length())) {
+            QChar next_ch = replacement.at(ch_idx + 1);
+            if ((next_ch >= '0') and (next_ch <= '9')) {
+                expanded += match.captured(next_ch.digitValue());
+                ch_idx += 1;
+                continue;
+            }
+            if (next_ch == '\\') {
+                expanded += next_ch;
+                ch_idx += 1;
+                continue;
+            }
+        }
+        expanded += ch;
+    }
+    return expanded;
+}
+
+// Searches a contiguous run of lines, lines being independent of each other
+struct MySQL_Find_Chunk_Job {
+    typedef QVector<MySQL_Find_Match> result_type;
+
+    const QString *text;
+    const int *line_starts;
+    // Per line tokens, for Skip_Strings_And_Comments only
+    const MySQL_Lexed_Block *blocks;
+    const MySQL_Find_Options *options;
+    QStringMatcher matcher;
+    QRegularExpression regular_expression;
+    QSharedPointer<QAtomicInt> generation;
+    int job_generation;
+
+    bool
+    isSkipped ( int line,
+                int offset ) const {
+        const QVector<MySQL_Token> &tokens = blocks[line].tokens;
+        QVector<MySQL_Token>::const_iterator token =
+          std::upper_bound(tokens.constBegin(), tokens.constEnd(), offset, Token_Offset_Less_Than);
+        if (token == tokens.constBegin()) return false;
+        token -= 1;
+        return (offset < (token->offset + token->length)) and
+               ((token->token_class == MySQL_Token::String) or (token->token_class == MySQL_Token::Comment));
+    }
+
+    result_type
+    operator() ( const QPair<int, int> &chunk ) const {
+        QVector<MySQL_Find_Match> matches;
+        MySQL_Find_Match match;
+        for (int line = chunk.first; line < chunk.second; line += 1) {
+            if (((line % 256) == 0) and
+                (not (generation->loadAcquire() == job_generation))) return QVector<MySQL_Find_Match>();
+
+            // Lines are separated by '\n'
+            int line_start = line_starts[line];
+            int line_length = line_starts[line + 1] - line_start - 1;
+            match.line = line;
+            int from = 0;
+            while (from <= line_length) {
+                // Line relative, as are from and the line's tokens
+                int line_position;
+                if (options->Regular_Expression) {
+                    QRegularExpressionMatch line_match =
+                      regular_expression.match(QStringRef(text, line_start, line_length), from);
+                    if (not line_match.hasMatch()) break;
+                    // ... but captures are offsets in the whole text
+                    line_position = line_match.capturedStart() - line_start;
+                    match.length = line_match.capturedLength();
+                    if (options->Replace) match.replacement = Expand_Replacement(options->Replacement, line_match);
+                } else {
+                    line_position = matcher.indexIn(text->constData() + line_start, line_length, from);
+                    if (line_position < 0) break;
+                    match.length = options->Pattern.length();
+                    if (options->Replace) match.replacement = options->Replacement;
+                }
+                // Empty matches move on by a character
+                from = line_position + qMax(1, match.length);
+                if (options->Skip_Strings_And_Comments and isSkipped(line, line_position)) continue;
+
+                match.position = line_start + line_position;
+                matches << match;
+                if (((matches.count() % 4096) == 0) and
+                    (not (generation->loadAcquire() == job_generation))) return QVector<MySQL_Find_Match>();
+            }
+        }
+        return matches;
+    }
+};
+
+static MySQL_Find_Result
+Find_All_In_Parallel ( QString text,
+                       MySQL_Find_Options options,
+                       const MySQL_Editor *editor,
+                       QSharedPointer<QAtomicInt> generation,
+                       int job_generation ) {
+    // Runs on a worker thread, text is a snapshot of the document with ...
+    // ... lines separated by '\n'. Chunks of lines are searched on all ...
+    // ... cores, their matches concatenated in order are sorted.
+    MySQL_Find_Result result;
+    QVector<int> line_starts;
+    line_starts << 0;
+    const ushort *text_data = text.utf16();
+    int newline_idx = Scan_For_Characters(text_data, 0, text.length(), '\n', '\n', '\n', '\n');
+    while (newline_idx < text.length()) {
+        line_starts << (newline_idx + 1);
+        newline_idx = Scan_For_Characters(text_data, newline_idx + 1, text.length(), '\n', '\n', '\n', '\n');
+    }
+    line_starts << (text.length() + 1);
+    int line_count = line_starts.count() - 1;
+
+    // Strings and comments as the highlighter lexes them
+    QVector<MySQL_Lexed_Block> blocks;
+    if (options.Skip_Strings_And_Comments) {
+        blocks = Lex_Separated_Blocks_In_Parallel(text, '\n', int(MySQL_Editor_Highlighter::Start),
+                                                  editor, generation, job_generation);
+        if (not (generation->loadAcquire() == job_generation)) return result;
+    }
+
+    int chunk_characters = qMax(Find_Min_Chunk_Characters,
+                                text.length() / (4 * qMax(1, QThread::idealThreadCount())));
+    QList<QPair<int, int> > chunks;
+    int chunk_begin = 0;
+    for (int line = 1; line <= line_count; line += 1) {
+        if ((line == line_count) or
+            ((line_starts.at(line) - line_starts.at(chunk_begin)) >= chunk_characters)) {
+            chunks << qMakePair(chunk_begin, line);
+            chunk_begin = line;
+        }
+    }
+
+    MySQL_Find_Chunk_Job chunk_job;
+    chunk_job.text = &text;
+    chunk_job.line_starts = line_starts.constData();
+    chunk_job.blocks = blocks.constData();
+    chunk_job.options = &options;
+    if (options.Regular_Expression) {
+        QRegularExpression::PatternOptions pattern_options = QRegularExpression::NoPatternOption;
+        if (options.Case_Sensitivity == Qt::CaseInsensitive)
+            pattern_options |= QRegularExpression::CaseInsensitiveOption;
+        chunk_job.regular_expression = QRegularExpression(options.Pattern, pattern_options);
+        // Compiled once here, rather than by the first match of each thread
+        chunk_job.regular_expression.optimize();
+    } else {
+        chunk_job.matcher = QStringMatcher(options.Pattern, options.Case_Sensitivity);
+    }
+    chunk_job.generation = generation;
+    chunk_job.job_generation = job_generation;
+    QList<QVector<MySQL_Find_Match> > chunk_matches =
+      QtConcurrent::blockingMapped<QList<QVector<MySQL_Find_Match> > >(chunks, chunk_job);
+    if (not (generation->loadAcquire() == job_generation)) return result;
+
+    int match_count = 0;
+    foreach (const QVector<MySQL_Find_Match> &matches, chunk_matches) match_count += matches.count();
+    result.Matches.reserve(match_count);
+    int previous_line = -1;
+    foreach (const QVector<MySQL_Find_Match> &matches, chunk_matches) {
+        foreach (const MySQL_Find_Match &match, matches) {
+            if (not (match.line == previous_line)) result.Matching_Lines += 1;
+            previous_line = match.line;
+        }
+        result.Matches += matches;
+    }
+
+    if (options.Replace and (result.Matches.count() > Replace_All_Max_Edits)) {
+        // An edit per match would relayout and rehighlight as many times. ...
+        // ... Runs of nearby matches are spliced into one edit each, split ...
+        // ... at the widest gaps between matches, so at most ...
+        // ... Replace_All_Max_Edits edits rewrite the least unchanged text.
+        QVector<int> gaps;
+        gaps.reserve(result.Matches.count() - 1);
+        for (int match_idx = 1; match_idx < result.Matches.count(); match_idx += 1) {
+            const MySQL_Find_Match &previous_match = result.Matches.at(match_idx - 1);
+            gaps << (result.Matches.at(match_idx).position - (previous_match.position + previous_match.length));
+        }
+        QVector<int>::iterator split_gap_position = gaps.end() - (Replace_All_Max_Edits - 1);
+        std::nth_element(gaps.begin(), split_gap_position, gaps.end());
+        int split_gap = *split_gap_position;
+        // Splitting at every gap wider than split_gap leaves room for some equal to it
+        int equal_splits = Replace_All_Max_Edits - 1;
+        for (QVector<int>::const_iterator gap = split_gap_position; gap < gaps.constEnd(); ++gap)
+            if (*gap > split_gap) equal_splits -= 1;
+
+        MySQL_Find_Match span = result.Matches.first();
+        for (int match_idx = 1; match_idx < result.Matches.count(); match_idx += 1) {
+            if (((match_idx % 4096) == 0) and
+                (not (generation->loadAcquire() == job_generation))) return MySQL_Find_Result();
+
+            const MySQL_Find_Match &match = result.Matches.at(match_idx);
+            int span_end = span.position + span.length;
+            int gap = match.position - span_end;
+            bool split = (gap > split_gap);
+            if ((gap == split_gap) and (equal_splits > 0)) {
+                equal_splits -= 1;
+                split = true;
+            }
+            if (split) {
+                result.Replace_Spans << span;
+                span = match;
+                continue;
+            }
+            span.replacement += text.midRef(span_end, gap);
+            span.replacement += match.replacement;
+            span.length = (match.position + match.length) - span.position;
+        }
+        result.Replace_Spans << span;
+    }
+    return result;
+}
+
+#define Default_Deferred_Block_Threshold 10000
+#define Default_Slice_Budget_Msecs 8
+#define Default_Priority_Window_Blocks 200
+#define Default_Long_Line_Threshold 100000
+#define Long_Line_Chunk_Characters (64 * 1024)
 
 MySQL_Editor_Highlighter::MySQL_Editor_Highlighter ( QTextDocument *parent ) :
-                            QSyntaxHighlighter ( parent ),
-                            m_markCaseSensitivity(Qt::CaseInsensitive) {
+                            QSyntaxHighlighter ( parent ) {
     // Default color scheme, similar to Qt Creator's default
     m_colors[MySQL_Editor::Normal]     = QColor(0, 0, 0);
     m_colors[MySQL_Editor::Comment]    = QColor(128, 128, 128);
@@ -39,7 +1338,29 @@ MySQL_Editor_Highlighter::MySQL_Editor_Highlighter ( QTextDocument *parent ) :
     m_colors[MySQL_Editor::Type]       = QColor(0, 96, 96);
     m_colors[MySQL_Editor::Identifier] = QColor(0, 32, 192);
 
-    m_colors[MySQL_Editor::Marker]     = QColor(255, 255, 0);
+    Deferred_Block_Threshold = Default_Deferred_Block_Threshold;
+    Slice_Budget_Msecs = Default_Slice_Budget_Msecs;
+    Priority_First_Block = 0;
+    Priority_Last_Block = Default_Priority_Window_Blocks;
+    Budget_Unlimited = false;
+    Priority_Update_Queued = false;
+    Pending_Timer = new QTimer(this);
+    Pending_Timer->setSingleShot(true);
+    Pending_Timer->setInterval(0);
+    connect(Pending_Timer, SIGNAL(timeout()), this, SLOT(highlightPendingSlice()));
+
+    Parallel_Lex_Watcher = new QFutureWatcher<QVector<MySQL_Lexed_Block> >(this);
+    Parallel_Lex_Generation = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+    Parallel_Lex_Revision = -1;
+    Parallel_First_Block = 0;
+    connect(Parallel_Lex_Watcher, SIGNAL(finished()), this, SLOT(onParallelLexingFinished()));
+
+    Delimiters << ";";
+
+    Long_Line_Threshold = Default_Long_Line_Threshold;
+    Visible_First_Column = 0;
+    Visible_Last_Column = 255;
+    Long_Line_Update_Queued = false;
 }
 
 void
@@ -47,39 +1368,565 @@ MySQL_Editor_Highlighter::setHighlightMySQLEditor ( MySQL_Editor *highlight_mysq
     Highlight_MySQL_Editor = highlight_mysql_editor;
 }
 
+MySQL_Bracket_Tree *
+MySQL_Editor_Highlighter::bracketTree ( ) {
+    return &Bracket_Tree;
+}
+
+int
+MySQL_Editor_Highlighter::lexicalState ( int block_state ) {
+    int lexical_state = block_state & Lexical_State_Mask;
+    if ((block_state < 0) or (lexical_state == Pending)) return Start;
+    return lexical_state;
+}
+
+bool
+MySQL_Editor_Highlighter::isDeferredState ( int block_state ) {
+    return ((block_state >= 0) and
+            (((block_state & Lexical_State_Mask) == Pending) or (block_state & Speculative_Flag)));
+}
+
+QString
+MySQL_Editor_Highlighter::delimiter ( int block_state ) const {
+    int delimiter_idx = ((block_state < 0) ? 0 : (block_state >> Delimiter_Shift));
+    return ((delimiter_idx < Delimiters.count()) ? Delimiters.at(delimiter_idx) : Delimiters.first());
+}
+
+int
+MySQL_Editor_Highlighter::delimiterCommand ( const QString &text,
+                                             int state,
+                                             MySQLBlockData *block_data ) {
+    // The mysql client's "DELIMITER $$", alone on a line outside any ...
+    // ... string or comment. Ends the statement before it, and is no ...
+    // ... statement itself. Returns the new delimiter's index, or -1.
+    if (not (lexicalState(state) == Start)) return -1;
+    static const QString command("DELIMITER");
+    int ch_idx = 0;
+    while ((ch_idx < text.length()) and text.at(ch_idx).isSpace()) ch_idx += 1;
+    if (not (text.midRef(ch_idx, command.length()).compare(command, Qt::CaseInsensitive) == 0)) return -1;
+    ch_idx += command.length();
+    if (not ((ch_idx < text.length()) and text.at(ch_idx).isSpace())) return -1;
+    while ((ch_idx < text.length()) and text.at(ch_idx).isSpace()) ch_idx += 1;
+    int delimiter_start = ch_idx;
+    while ((ch_idx < text.length()) and (not text.at(ch_idx).isSpace())) ch_idx += 1;
+    if (ch_idx == delimiter_start) return -1;
+
+    QString new_delimiter = text.mid(delimiter_start, ch_idx - delimiter_start);
+    int delimiter_idx = Delimiters.indexOf(new_delimiter);
+    if (delimiter_idx < 0) {
+        delimiter_idx = Delimiters.count();
+        Delimiters << new_delimiter;
+    }
+    MySQL_Statement_End statement_end = { 0, text.length() };
+    block_data->Statement_Ends.append(statement_end);
+    return delimiter_idx;
+}
+
 void
-MySQL_Editor_Highlighter::setColor ( MySQL_Editor::ColorComponent component,
-                                     const QColor &color ) {
-    m_colors[component] = color;
-    rehighlight();
+MySQL_Editor_Highlighter::findStatementEnds ( const QString &text,
+                                              int from,
+                                              int to,
+                                              const QVector<MySQL_Token> &tokens,
+                                              const QString &delimiter,
+                                              MySQLBlockData *block_data ) {
+    // Delimiters from from to to, tokens those lexed over the same range. ...
+    // ... One in a string, comment or backticked identifier doesn't count, ...
+    // ... unless it starts a comment, as "//" would.
+    if (delimiter.isEmpty()) return;
+    const ushort *text_data = text.utf16();
+    ushort first_ch = delimiter.at(0).unicode();
+    int token_idx = 0;
+    int position = Scan_For_Characters(text_data, from, to, first_ch, first_ch, first_ch, first_ch);
+    while (position < to) {
+        int next_position = position + 1;
+        if (text.midRef(position, delimiter.length()) == delimiter) {
+            while ((token_idx < tokens.count()) and
+                   ((tokens.at(token_idx).offset + tokens.at(token_idx).length) <= position))
+                token_idx += 1;
+            bool quoted = false;
+            if ((token_idx < tokens.count()) and (tokens.at(token_idx).offset <= position)) {
+                const MySQL_Token &token = tokens.at(token_idx);
+                quoted = ((token.token_class == MySQL_Token::String) or
+                          (token.token_class == MySQL_Token::Backticked_Identifier) or
+                          ((token.token_class == MySQL_Token::Comment) and (token.offset < position)));
+            }
+            if (not quoted) {
+                MySQL_Statement_End statement_end = { position, position + delimiter.length() };
+                block_data->Statement_Ends.append(statement_end);
+                next_position = position + delimiter.length();
+            }
+        }
+        position = Scan_For_Characters(text_data, next_position, to, first_ch, first_ch, first_ch, first_ch);
+    }
 }
 
 void
-MySQL_Editor_Highlighter::highlightBlock ( const QString &text ) {
-    // parsing state
-    enum {
-        Start = 0,
-        Number = 1,
-        Identifier = 2,
-        Backticked_Identifier = 3,
-        String = 4,
-        Comment = 5,
-        To_EOL_Comment = 6
-    };
+MySQL_Editor_Highlighter::setDeferredHighlighting ( int block_threshold,
+                                                    int slice_budget_msecs ) {
+    Deferred_Block_Threshold = block_threshold;
+    Slice_Budget_Msecs = qMax(1, slice_budget_msecs);
+}
+
+void
+MySQL_Editor_Highlighter::setPriorityWindow ( int first_block_number,
+                                              int last_block_number ) {
+    Priority_First_Block = first_block_number;
+    Priority_Last_Block = last_block_number;
+    if (Pending_Cursor.isNull() or Priority_Update_Queued) return;
+
+    // Scrolling may be signalled from within a layout update, which ...
+    // ... QSyntaxHighlighter must not re-enter
+    Priority_Update_Queued = true;
+    QMetaObject::invokeMethod(this, "highlightPriorityWindow", Qt::QueuedConnection);
+}
+
+void
+MySQL_Editor_Highlighter::highlightPriorityWindow ( ) {
+    Priority_Update_Queued = false;
+    if (Pending_Cursor.isNull()) return;
+
+    // Bring the window's pending blocks up now, speculatively if the ...
+    // ... blocks before them are not lexed yet. Highlighting cascades ...
+    // ... through following blocks, so most iterations just skip.
+    QTextBlock block = document()->findBlockByNumber(qMax(0, Priority_First_Block));
+    for (int block_number = qMax(0, Priority_First_Block);
+         block.isValid() and (block_number <= Priority_Last_Block);
+         block_number += 1) {
+        if ((block.userState() & Lexical_State_Mask) == Pending) rehighlightBlock(block);
+        block = block.next();
+    }
+    emit deferredBlocksHighlighted();
+}
+
+bool
+MySQL_Editor_Highlighter::hasPendingHighlighting ( const QTextBlock &last_block ) const {
+    if (Pending_Cursor.isNull()) return false;
+    if (not last_block.isValid()) return true;
+
+    QTextBlock block = nextDeferredBlock(Pending_Cursor.block());
+    return block.isValid() and (block.position() <= last_block.position());
+}
+
+void
+MySQL_Editor_Highlighter::finishPendingHighlighting ( const QTextBlock &last_block ) {
+    // Without last_block the whole document. Deferred blocks past last_block ...
+    // ... stay with the idle-time slices, unless the cascade reaches them
+    if (Pending_Cursor.isNull()) return;
+
+    QTextBlock block = nextDeferredBlock(Pending_Cursor.block());
+    if (block.isValid() and last_block.isValid() and (block.position() > last_block.position())) return;
+
+    Budget_Unlimited = true;
+    while (block.isValid() and
+           ((not last_block.isValid()) or (block.position() <= last_block.position()))) {
+        rehighlightBlock(block);
+        block = nextDeferredBlock(block);
+    }
+    Budget_Unlimited = false;
+
+    if (block.isValid()) {
+        Pending_Cursor.setPosition(block.position());
+    }
+    else {
+        Pending_Cursor = QTextCursor();
+        Pending_Timer->stop();
+    }
+    emit deferredBlocksHighlighted();
+}
+
+void
+MySQL_Editor_Highlighter::highlightPendingSlice ( ) {
+    MySQL_Trace_Scope trace_scope((Highlight_MySQL_Editor ? Highlight_MySQL_Editor->trace() : 0), "highlightPendingSlice");
+    // One idle-time slice. Lexing the first deferred block for real changes ...
+    // ... its state, so QSyntaxHighlighter carries on into the following ...
+    // ... blocks until the budget runs out and a block stays deferred.
+    // Resumed by onParallelLexingFinished
+    if (Parallel_Lex_Watcher->isRunning()) return;
+
+    QTextBlock block = Pending_Cursor.isNull() ? QTextBlock() : nextDeferredBlock(Pending_Cursor.block());
+    if (block.isValid() and
+        (not (Parallel_Lex_Revision == document()->revision())) and
+        ((document()->characterCount() - block.position()) >= Parallel_Lex_Min_Characters)) {
+        // Big load, lex the rest of the document on all cores first
+        startParallelLexing(block);
+        return;
+    }
+
+    if (block.isValid()) {
+        Batch_Timer.invalidate();
+        rehighlightBlock(block);
+        block = nextDeferredBlock(block);
+    }
+
+    if (block.isValid()) {
+        Pending_Cursor.setPosition(block.position());
+        Pending_Timer->start();
+    }
+    else {
+        Pending_Cursor = QTextCursor();
+        Parallel_Blocks.clear();
+    }
+    emit deferredBlocksHighlighted();
+}
+
+void
+MySQL_Editor_Highlighter::startParallelLexing ( const QTextBlock &first_block ) {
+    QTextCursor text_cursor(document());
+    text_cursor.setPosition(first_block.position());
+    text_cursor.movePosition(QTextCursor::End, QTextCursor::KeepAnchor);
+
+    Parallel_Blocks.clear();
+    Parallel_Lex_Revision = document()->revision();
+    Parallel_First_Block = first_block.blockNumber();
+    int job_generation = Parallel_Lex_Generation->fetchAndAddOrdered(1) + 1;
+    Parallel_Lex_Watcher->setFuture(QtConcurrent::run(Lex_Blocks_In_Parallel,
+                                                      text_cursor.selectedText(),
+                                                      lexicalState(first_block.previous().userState()),
+                                                      Highlight_MySQL_Editor,
+                                                      Parallel_Lex_Generation,
+                                                      job_generation));
+}
+
+void
+MySQL_Editor_Highlighter::onParallelLexingFinished ( ) {
+    // Results are applied by the slices, if the document is unchanged
+    if (Parallel_Lex_Revision == document()->revision()) Parallel_Blocks = Parallel_Lex_Watcher->result();
+    if (not Pending_Cursor.isNull()) Pending_Timer->start();
+}
+
+void
+MySQL_Editor_Highlighter::cancelParallelLexing ( ) {
+    Parallel_Lex_Generation->fetchAndAddOrdered(1);
+    Parallel_Lex_Watcher->waitForFinished();
+    Parallel_Blocks.clear();
+}
+
+int
+MySQL_Editor_Highlighter::lexBlock ( const QString &text,
+                                     int state,
+                                     QVector<MySQL_Token> &tokens,
+                                     MySQLBlockData *block_data ) {
+    if ((Long_Line_Threshold >= 0) and (text.length() > Long_Line_Threshold))
+        return lexLongLine(text, state, tokens, block_data);
+
+    // Take the block's tokens from parallel lexing when they apply
+    if (not Parallel_Blocks.isEmpty()) {
+        if (Parallel_Lex_Revision == document()->revision()) {
+            int lexed_idx = currentBlock().blockNumber() - Parallel_First_Block;
+            if ((lexed_idx >= 0) and (lexed_idx < Parallel_Blocks.count())) {
+                const MySQL_Lexed_Block &lexed = Parallel_Blocks.at(lexed_idx);
+                if ((lexed.length == text.length()) and (lexed.entry_state == lexicalState(state))) {
+                    tokens = lexed.tokens;
+                    return lexed.exit_state;
+                }
+            }
+        }
+        else {
+            // Edited since, block numbers and states no longer line up
+            Parallel_Blocks.clear();
+        }
+    }
+    return lexText(text, state, Highlight_MySQL_Editor, tokens);
+}
+
+int
+MySQL_Editor_Highlighter::lexLongLine ( const QString &text,
+                                        int state,
+                                        QVector<MySQL_Token> &tokens,
+                                        MySQLBlockData *block_data ) {
+    // A multi-megabyte line, as in mysqldump's extended INSERTs. One pass ...
+    // ... in chunks ending between tokens, recording a checkpoint per chunk ...
+    // ... and summarizing brackets. Only the window's tokens are kept, so ...
+    // ... memory is bounded by the chunk and window sizes.
+    block_data->Long_Line = true;
+    windowOffsets(text.length(), block_data->Window_First, block_data->Window_Last);
+    for (uint pair = 0; pair < MySQL_Bracket_Pair_Count; pair += 1) {
+        block_data->Block_Summary[pair].net = 0;
+        block_data->Block_Summary[pair].min_prefix = 0;
+    }
+
+    QString statement_delimiter = delimiter(state);
+    QVector<MySQL_Token> chunk_tokens;
+    int position = 0;
+    while (position >= 0) {
+        MySQL_Lex_Checkpoint checkpoint = { position, state };
+        block_data->Checkpoints.append(checkpoint);
+        chunk_tokens.resize(0);
+        int chunk_start = position;
+        state = lexTextRange(text, state, Highlight_MySQL_Editor, chunk_tokens,
+                             position, position + Long_Line_Chunk_Characters, &position);
+        findStatementEnds(text, chunk_start, ((position < 0) ? text.length() : position),
+                          chunk_tokens, statement_delimiter, block_data);
+        foreach (const MySQL_Token &token, chunk_tokens) {
+            if (token.token_class == MySQL_Token::Bracket)
+                MySQL_Bracket_Tree::addBracket(block_data->Block_Summary, text.at(token.offset));
+            if (((token.offset + token.length) > block_data->Window_First) and
+                (token.offset <= block_data->Window_Last))
+                tokens.append(token);
+        }
+    }
+    return state;
+}
+
+static bool
+Checkpoint_Offset_Less_Than ( int offset,
+                              const MySQL_Lex_Checkpoint &checkpoint ) {
+    return offset < checkpoint.offset;
+}
+
+void
+MySQL_Editor_Highlighter::lexLongLineWindow ( const QTextBlock &block,
+                                              const MySQLBlockData *block_data,
+                                              int first_offset,
+                                              int last_offset,
+                                              QVector<MySQL_Token> &tokens,
+                                              QString &fragment,
+                                              int &fragment_offset ) const {
+    // Lexes from the checkpoint at or before first_offset to the one ...
+    // ... after last_offset, reading just that fragment of the block. ...
+    // ... Token offsets are relative to the block, fragment starts at fragment_offset.
+    const QVector<MySQL_Lex_Checkpoint> &checkpoints = block_data->Checkpoints;
+    QVector<MySQL_Lex_Checkpoint>::const_iterator first_checkpoint =
+      std::upper_bound(checkpoints.constBegin(), checkpoints.constEnd(), first_offset, Checkpoint_Offset_Less_Than) - 1;
+    QVector<MySQL_Lex_Checkpoint>::const_iterator end_checkpoint =
+      std::upper_bound(checkpoints.constBegin(), checkpoints.constEnd(), last_offset, Checkpoint_Offset_Less_Than);
+    fragment_offset = first_checkpoint->offset;
+    int fragment_end = ((end_checkpoint == checkpoints.constEnd()) ? (block.length() - 1) : end_checkpoint->offset);
+
+    QTextCursor text_cursor(document());
+    text_cursor.setPosition(block.position() + fragment_offset);
+    text_cursor.setPosition(block.position() + fragment_end, QTextCursor::KeepAnchor);
+    fragment = text_cursor.selectedText();
+
+    QVector<MySQL_Token> fragment_tokens;
+    lexText(fragment, first_checkpoint->state, Highlight_MySQL_Editor, fragment_tokens);
+    foreach (MySQL_Token token, fragment_tokens) {
+        token.offset += fragment_offset;
+        if (((token.offset + token.length) > first_offset) and (token.offset <= last_offset))
+            tokens.append(token);
+    }
+}
+
+void
+MySQL_Editor_Highlighter::formatLongLineWindow ( const QTextBlock &block ) {
+    // Moves a long line's window without QSyntaxHighlighter, which would ...
+    // ... copy the whole line and allocate a format per character
+    MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+    if (not (block_data and block_data->Long_Line and block.layout())) return;
+
+    int window_first;
+    int window_last;
+    windowOffsets(block.length() - 1, window_first, window_last);
+    QVector<MySQL_Token> tokens;
+    QString fragment;
+    int fragment_offset;
+    lexLongLineWindow(block, block_data, window_first, window_last, tokens, fragment, fragment_offset);
 
     QList<int> bracketPositions;
+    QString bracketCharacters;
+    QString bracket_list = MySQL_Bracket_List;
+    QVector<QTextLayout::FormatRange> formats;
+    foreach (const MySQL_Token &token, tokens) {
+        if (token.token_class == MySQL_Token::Bracket) {
+            QChar bracket = fragment.at(token.offset - fragment_offset);
+            if (bracket_list.contains(bracket)) {
+                bracketPositions += token.offset;
+                bracketCharacters += bracket;
+            }
+            continue;
+        }
+        QTextLayout::FormatRange format_range;
+        format_range.start = token.offset;
+        format_range.length = token.length;
+        format_range.format.setForeground(tokenColor(token.token_class));
+        formats.append(format_range);
+    }
 
-    int blockState = previousBlockState();
-    int bracketLevel = blockState >> 4;
-    int state = blockState & 15;
-    if (blockState < 0) {
-        bracketLevel = 0;
-        state = Start;
+    block_data->Tokens = tokens;
+    block_data->bracketPositions = bracketPositions;
+    block_data->bracketCharacters = bracketCharacters;
+    block_data->Window_First = window_first;
+    block_data->Window_Last = window_last;
+    block.layout()->setFormats(formats);
+    document()->markContentsDirty(block.position(), block.length());
+}
+
+void
+MySQL_Editor_Highlighter::windowOffsets ( int text_length,
+                                          int &first_offset,
+                                          int &last_offset ) const {
+    // The visible columns plus as many to either side
+    int visible_columns = Visible_Last_Column - Visible_First_Column + 1;
+    first_offset = qBound(0, Visible_First_Column - visible_columns, qMax(0, text_length - 1));
+    last_offset = qBound(first_offset, Visible_Last_Column + visible_columns, qMax(0, text_length - 1));
+}
+
+QColor
+MySQL_Editor_Highlighter::tokenColor ( int token_class ) const {
+    switch (token_class) {
+    case MySQL_Token::Operator:
+        return m_colors.value(MySQL_Editor::Operator);
+    case MySQL_Token::Number:
+        return m_colors.value(MySQL_Editor::Number);
+    case MySQL_Token::String:
+        return m_colors.value(MySQL_Editor::String);
+    case MySQL_Token::Comment:
+        return m_colors.value(MySQL_Editor::Comment);
+    case MySQL_Token::Keyword:
+        return m_colors.value(MySQL_Editor::Keyword);
+    case MySQL_Token::Function:
+        return m_colors.value(MySQL_Editor::Function);
+    case MySQL_Token::Type:
+        return m_colors.value(MySQL_Editor::Type);
+    case MySQL_Token::Interval:
+        return m_colors.value(MySQL_Editor::Interval);
+    default:
+        return m_colors.value(MySQL_Editor::Identifier);
     }
+}
+
+const MySQL_Editor_Counters &
+MySQL_Editor_Highlighter::counters ( ) const {
+    return Counters;
+}
+
+void
+MySQL_Editor_Highlighter::resetCounters ( ) {
+    Counters = MySQL_Editor_Counters();
+}
 
-    int start = 0;
-    int i = 0;
+void
+MySQL_Editor_Highlighter::setLongLineThreshold ( int line_threshold ) {
+    Long_Line_Threshold = line_threshold;
+}
+
+void
+MySQL_Editor_Highlighter::setHorizontalWindow ( int first_column,
+                                                int last_column ) {
+    Visible_First_Column = first_column;
+    Visible_Last_Column = qMax(first_column, last_column);
+    if (Long_Line_Update_Queued) return;
+
+    // As for the priority window, never re-enter from a layout update
+    Long_Line_Update_Queued = true;
+    QMetaObject::invokeMethod(this, "highlightLongLineWindows", Qt::QueuedConnection);
+}
+
+void
+MySQL_Editor_Highlighter::highlightLongLineWindows ( ) {
+    // Re-format the long lines in the priority window whose window no ...
+    // ... longer covers the visible columns
+    Long_Line_Update_Queued = false;
+    QTextBlock block = document()->findBlockByNumber(qMax(0, Priority_First_Block));
+    for (int block_number = qMax(0, Priority_First_Block);
+         block.isValid() and (block_number <= Priority_Last_Block);
+         block_number += 1) {
+        MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+        if (block_data and block_data->Long_Line) {
+            int text_last = block.length() - 2;
+            if ((qMin(Visible_First_Column, text_last) < block_data->Window_First) or
+                (qMin(Visible_Last_Column, text_last) > block_data->Window_Last))
+                formatLongLineWindow(block);
+        }
+        block = block.next();
+    }
+}
+
+QVector<MySQL_Token>
+MySQL_Editor_Highlighter::blockTokens ( const QTextBlock &block,
+                                        int first_offset,
+                                        int last_offset ) const {
+    MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+    if (not block_data) return QVector<MySQL_Token>();
+    if (not block_data->Long_Line) return block_data->Tokens;
+
+    first_offset = qMax(0, first_offset);
+    if ((last_offset < 0) or (last_offset > (block.length() - 2))) last_offset = block.length() - 2;
+    if ((first_offset >= block_data->Window_First) and (last_offset <= block_data->Window_Last))
+        return block_data->Tokens;
+
+    QVector<MySQL_Token> tokens;
+    QString fragment;
+    int fragment_offset;
+    lexLongLineWindow(block, block_data, first_offset, last_offset, tokens, fragment, fragment_offset);
+    return tokens;
+}
+
+void
+MySQL_Editor_Highlighter::endHighlightBatch ( ) {
+    Batch_Timer.invalidate();
+}
+
+bool
+MySQL_Editor_Highlighter::isDeferring ( ) const {
+    return ((Deferred_Block_Threshold >= 0) and (document()->blockCount() > Deferred_Block_Threshold));
+}
+
+bool
+MySQL_Editor_Highlighter::isBudgetLeft ( ) {
+    if (Budget_Unlimited) return true;
+
+    // The budget is per event loop iteration, whether highlighting was ...
+    // ... triggered by an edit, a rehighlight or an idle-time slice
+    if (not Batch_Timer.isValid()) {
+        Batch_Timer.start();
+        QTimer::singleShot(0, this, SLOT(endHighlightBatch()));
+    }
+    return Batch_Timer.elapsed() < Slice_Budget_Msecs;
+}
+
+void
+MySQL_Editor_Highlighter::notePendingBlock ( ) {
+    if (Pending_Cursor.isNull() or (currentBlock().position() < Pending_Cursor.position()))
+        Pending_Cursor = QTextCursor(currentBlock());
+    if (not Pending_Timer->isActive()) Pending_Timer->start();
+}
+
+QTextBlock
+MySQL_Editor_Highlighter::nextDeferredBlock ( QTextBlock block ) const {
+    while (block.isValid() and (not isDeferredState(block.userState()))) block = block.next();
+    return block;
+}
+
+void
+MySQL_Editor_Highlighter::setColor ( MySQL_Editor::ColorComponent component,
+                                     const QColor &color ) {
+    m_colors[component] = color;
+    rehighlight();
+}
+
+int
+MySQL_Editor_Highlighter::lexText ( const QString &text,
+                                    int state,
+                                    const MySQL_Editor *editor,
+                                    QVector<MySQL_Token> &tokens ) {
+    // The one SQL tokenizer, shared by the highlighter, auto uppercasing, ...
+    // ... the formatter and Initial_SQL_Keyword. Returns the state at the end ...
+    // ... of text, Start or Comment.
+    return lexTextRange(text, state, editor, tokens, 0, text.length() + 1, 0);
+}
+
+int
+MySQL_Editor_Highlighter::lexTextRange ( const QString &text,
+                                         int state,
+                                         const MySQL_Editor *editor,
+                                         QVector<MySQL_Token> &tokens,
+                                         int from,
+                                         int stop_after,
+                                         int *stop_position ) {
+    // Stopping in Start only, where the next token begins, lexing resumed ...
+    // ... there in Start yields the same tokens as one uninterrupted pass
+    state = lexicalState(state);
+    QChar string_quote = '\'';
+
+    const ushort *text_data = text.utf16();
+    int start = from;
+    int i = from;
     while (i <= text.length()) {
+        if ((state == Start) and (i >= stop_after)) {
+            if (stop_position) *stop_position = i;
+            return Start;
+        }
         QChar ch = (i < text.length()) ? text.at(i) : QChar();
         QChar next_ch = ((i + 1) < text.length()) ? text.at(i + 1) : QChar();
 
@@ -109,6 +1956,7 @@ MySQL_Editor_Highlighter::highlightBlock ( const QString &text ) {
                 ++i;
                 state = Backticked_Identifier;
             } else if ((ch == '\'') or (ch == '\"')) {
+                string_quote = ch;
                 ++i;
                 state = String;
             } else if ((ch == '/') and (next_ch == '*')) {
@@ -123,17 +1971,16 @@ MySQL_Editor_Highlighter::highlightBlock ( const QString &text ) {
                 ++i;
                 state = To_EOL_Comment;
             } else if ((ch == '/') and (next_ch == '/')) {
-                i = text.length();
-                setFormat(start, text.length(), m_colors[MySQL_Editor::Comment]);
+                ++i;
+                ++i;
+                state = To_EOL_Comment;
             } else {
-                if (not QString("(){}[]").contains(ch))
-                    setFormat(start, 1, m_colors[MySQL_Editor::Operator]);
-                if ((ch == Open_Fold_Bracket) or (ch == Close_Fold_Bracket)) {
-                    bracketPositions += i;
-                    if (ch == Open_Fold_Bracket)
-                        bracketLevel++;
+                if (i < text.length()) {
+                    if ((ch == '(') or (ch == ')') or (ch == '{') or
+                        (ch == '}') or (ch == '[') or (ch == ']'))
+                        tokens.append(MySQL_Token(start, 1, MySQL_Token::Bracket));
                     else
-                        bracketLevel--;
+                        tokens.append(MySQL_Token(start, 1, MySQL_Token::Operator));
                 }
                 ++i;
                 state = Start;
@@ -145,7 +1992,7 @@ MySQL_Editor_Highlighter::highlightBlock ( const QString &text ) {
                 (not (ch.isDigit() or (ch == '.') or
                       (ch == '+') or (ch == '-') or
                       (ch == 'E') or (ch == 'e')))) {
-                setFormat(start, i - start, m_colors[MySQL_Editor::Number]);
+                tokens.append(MySQL_Token(start, i - start, MySQL_Token::Number));
                 state = Start;
             } else {
                 ++i;
@@ -162,19 +2009,19 @@ MySQL_Editor_Highlighter::highlightBlock ( const QString &text ) {
             if (ch.isSpace() or
                 (not (ch.isLetter() or ch.isDigit() or (ch == '_') or (ch == '$')))) {
                 // If (ch == '.'), it's an identifier
-                QString token = text.mid(start, i - start).trimmed();
-                if (token.startsWith('.') or (ch == '.'))
-                    setFormat(start, i - start, m_colors[MySQL_Editor::Identifier]);
-                else if (Highlight_MySQL_Editor->isKeyword(token.toUpper()))
-                    setFormat(start, i - start, m_colors[MySQL_Editor::Keyword]);
-                else if (Highlight_MySQL_Editor->isFunction(token.toUpper()))
-                    setFormat(start, i - start, m_colors[MySQL_Editor::Function]);
-                else if (Highlight_MySQL_Editor->isType(token.toUpper()))
-                    setFormat(start, i - start, m_colors[MySQL_Editor::Type]);
-                else if (Highlight_MySQL_Editor->isInterval(token.toUpper()))
-                    setFormat(start, i - start, m_colors[MySQL_Editor::Interval]);
+                int word_class = MySQL_Keyword_Table::No_Class;
+                if (editor and (not ((text.at(start) == '.') or (ch == '.'))))
+                    word_class = editor->classifyWord(text.constData() + start, i - start);
+                if (word_class & MySQL_Keyword_Table::Keyword_Class)
+                    tokens.append(MySQL_Token(start, i - start, MySQL_Token::Keyword));
+                else if (word_class & MySQL_Keyword_Table::Function_Class)
+                    tokens.append(MySQL_Token(start, i - start, MySQL_Token::Function));
+                else if (word_class & MySQL_Keyword_Table::Type_Class)
+                    tokens.append(MySQL_Token(start, i - start, MySQL_Token::Type));
+                else if (word_class & MySQL_Keyword_Table::Interval_Class)
+                    tokens.append(MySQL_Token(start, i - start, MySQL_Token::Interval));
                 else
-                    setFormat(start, i - start, m_colors[MySQL_Editor::Identifier]);
+                    tokens.append(MySQL_Token(start, i - start, MySQL_Token::Identifier));
                 state = Start;
             } else {
                 ++i;
@@ -184,10 +2031,11 @@ MySQL_Editor_Highlighter::highlightBlock ( const QString &text ) {
         case Backticked_Identifier:
             if (ch == '`') {
                 ++i; // Closing backtick is part of identifier, incorporate it
-                setFormat(start, i - start, m_colors[MySQL_Editor::Identifier]);
+                tokens.append(MySQL_Token(start, i - start, MySQL_Token::Backticked_Identifier));
                 state = Start;
             } else {
                 ++i;
+                i = Scan_For_Characters(text_data, i, text.length(), '`', '`', '`', '`');
             }
             break;
 
@@ -200,12 +2048,12 @@ MySQL_Editor_Highlighter::highlightBlock ( const QString &text ) {
                 ++i;
                 ++i;
             }
-            else if (ch == text.at(start)) {
+            else if (ch == string_quote) {
                 QChar prev_prev = (i > 1) ? text.at(i - 2) : QChar();
                 QChar prev = (i > 0) ? text.at(i - 1) : QChar();
                 if ((not (prev == '\\')) or ((prev_prev == '\\') and (prev == '\\'))) {
                     ++i;
-                    setFormat(start, i - start, m_colors[MySQL_Editor::String]);
+                    tokens.append(MySQL_Token(start, i - start, MySQL_Token::String));
                     state = Start;
                 }
                 else {
@@ -218,26 +2066,32 @@ MySQL_Editor_Highlighter::highlightBlock ( const QString &text ) {
                 // For example, an invalid escape sequence.
                 ++i;
             }
+            if (state == String)
+                // Nothing but a backslash or the quote can end or escape the string
+                i = Scan_For_Characters(text_data, i, text.length(),
+                                        '\\', string_quote.unicode(), '\\', string_quote.unicode());
             break;
 
         case Comment:
             if ((ch == '*') and (next_ch == '/')) {
                 ++i; // "*/" part of comment ...
                 ++i; // ... incorporate
-                setFormat(start, i - start, m_colors[MySQL_Editor::Comment]);
+                tokens.append(MySQL_Token(start, i - start, MySQL_Token::Comment));
                 state = Start;
             } else {
                 ++i;
+                i = Scan_For_Characters(text_data, i, text.length(), '*', '*', '*', '*');
             }
             break;
 
         case To_EOL_Comment:
             // (ch == '\0') == true, apparently
             if ((ch == '\n') or (ch == '\0')) {
-                setFormat(start, i - start, m_colors[MySQL_Editor::Comment]);
+                tokens.append(MySQL_Token(start, i - start, MySQL_Token::Comment));
                 state = Start;
             } else {
                 ++i;
+                i = Scan_For_Characters(text_data, i, text.length(), '\n', '\0', '\n', '\0');
             }
             break;
 
@@ -247,45 +2101,103 @@ MySQL_Editor_Highlighter::highlightBlock ( const QString &text ) {
         }
     }
 
+    // Only comments continue on the next line. An unterminated string or ...
+    // ... backticked identifier ends with its line, so typing a quote ...
+    // ... leaves the following blocks' states alone.
     if (state == Comment)
-        setFormat(start, text.length(), m_colors[MySQL_Editor::Comment]);
-    else
+        tokens.append(MySQL_Token(start, text.length() - start, MySQL_Token::Comment));
+    else {
+        if (state == String)
+            tokens.append(MySQL_Token(start, text.length() - start, MySQL_Token::String));
+        else if (state == Backticked_Identifier)
+            tokens.append(MySQL_Token(start, text.length() - start, MySQL_Token::Backticked_Identifier));
         state = Start;
+    }
+
+    if (stop_position) *stop_position = -1;
+    return state;
+}
+
+void
+MySQL_Editor_Highlighter::highlightBlock ( const QString &text ) {
+    MySQL_Counter_Scope counter_scope(Counters.Highlighted_Blocks, Counters.Highlight_Nsecs);
+    MySQL_Trace_Scope trace_scope((Highlight_MySQL_Editor ? Highlight_MySQL_Editor->trace() : 0), "highlightBlock");
+
+    // The per-block bracket index, only brackets outside strings and comments.
+    // QSyntaxHighlighter re-runs this for the blocks touched by each ...
+    // ... contentsChange(pos, removed, added), so the index is maintained ...
+    // ... in time proportional to the edit. Stale entries must be cleared.
+    // Every block gets data, the depth tree relies on one node per block.
+    MySQLBlockData *blockData = reinterpret_cast<MySQLBlockData*>(currentBlock().userData());
+    if (!blockData) {
+        blockData = new MySQLBlockData;
+        currentBlock().setUserData(blockData);
+        QTextBlock previousBlock = currentBlock().previous();
+        while (previousBlock.isValid() and (not previousBlock.userData()))
+            previousBlock = previousBlock.previous();
+        Bracket_Tree.insertAfter(blockData,
+                                 reinterpret_cast<MySQLBlockData*>(previousBlock.userData()));
+    }
+
+    QVector<MySQL_Token> tokens;
+    int state = Pending;
+    int previous_state = previousBlockState();
+    blockData->Long_Line = false;
+    blockData->Checkpoints.clear();
+    blockData->Statement_Ends.clear();
+    if (not isDeferring()) {
+        state = lexBlock(text, previous_state, tokens, blockData);
+    }
+    else {
+        // Large document, viewport first. Blocks in the priority window ...
+        // ... are always lexed, from a guessed entry state if need be, ...
+        // ... others only while this event loop iteration's budget lasts.
+        int block_number = currentBlock().blockNumber();
+        bool in_window = ((block_number >= Priority_First_Block) and (block_number <= Priority_Last_Block));
+        if ((not isDeferredState(previous_state)) and (in_window or isBudgetLeft()))
+            state = lexBlock(text, previous_state, tokens, blockData);
+        else if (in_window)
+            state = lexBlock(text, previous_state, tokens, blockData) | Speculative_Flag;
+        if (isDeferredState(state)) notePendingBlock();
+    }
+    if (not ((state & Lexical_State_Mask) == Pending)) Counters.Highlighted_Characters += text.length();
+
+    QList<int> bracketPositions;
+    QString bracketCharacters;
+    QString bracket_list = MySQL_Bracket_List;
 
-    if (!m_markString.isEmpty()) {
-        int pos = 0;
-        int len = m_markString.length();
-        QTextCharFormat markerFormat;
-        markerFormat.setBackground(m_colors[MySQL_Editor::Marker]);
-        markerFormat.setForeground(m_colors[MySQL_Editor::Normal]);
-        for (;;) {
-            pos = text.indexOf(m_markString, pos, m_markCaseSensitivity);
-            if (pos < 0)
-                break;
-            setFormat(pos, len, markerFormat);
-            ++pos;
+    foreach (const MySQL_Token &token, tokens) {
+        if (token.token_class == MySQL_Token::Bracket) {
+            if (bracket_list.contains(text.at(token.offset))) {
+                bracketPositions += token.offset;
+                bracketCharacters += text.at(token.offset);
+            }
+        }
+        else {
+            setFormat(token.offset, token.length, tokenColor(token.token_class));
         }
     }
 
-    if (!bracketPositions.isEmpty()) {
-        MySQLBlockData *blockData = reinterpret_cast<MySQLBlockData*>(currentBlock().userData());
-        if (!blockData) {
-            blockData = new MySQLBlockData;
-            currentBlock().setUserData(blockData);
+    // Statement ends, long lines found theirs while lexing. The delimiter ...
+    // ... in effect goes with the state, so a DELIMITER command cascades.
+    if (not ((state & Lexical_State_Mask) == Pending)) {
+        int delimiter_idx = (blockData->Long_Line ? -1 : delimiterCommand(text, previous_state, blockData));
+        if (delimiter_idx < 0) {
+            delimiter_idx = ((previous_state < 0) ? 0 : (previous_state >> Delimiter_Shift));
+            if (not blockData->Long_Line)
+                findStatementEnds(text, 0, text.length(), tokens, delimiter(previous_state), blockData);
         }
-        blockData->bracketPositions = bracketPositions;
+        state |= (delimiter_idx << Delimiter_Shift);
     }
 
-    blockState = (state & 15) | (bracketLevel << 4);
-    setCurrentBlockState(blockState);
-}
+    blockData->bracketPositions = bracketPositions;
+    blockData->bracketCharacters = bracketCharacters;
+    blockData->Tokens = tokens;
+    // Long lines summarized their brackets while lexing, all of them
+    Bracket_Tree.update(blockData, not blockData->Long_Line);
 
-void
-MySQL_Editor_Highlighter::mark ( const QString &str,
-                          Qt::CaseSensitivity caseSensitivity ) {
-    m_markString = str;
-    m_markCaseSensitivity = caseSensitivity;
-    rehighlight();
+    setCurrentBlockState(state);
+    if (blockData->Long_Line) emit longLineHighlighted();
 }
 
 MySQL_Editor_Sidebar::MySQL_Editor_Sidebar ( MySQL_Editor *editor ) : QWidget ( editor ),
@@ -321,6 +2233,8 @@ MySQL_Editor_Sidebar::mousePressEvent ( QMouseEvent *event ) {
 
 void
 MySQL_Editor_Sidebar::paintEvent ( QPaintEvent *event ) {
+    MySQL_Editor *editor = qobject_cast<MySQL_Editor*>(parent());
+    MySQL_Trace_Scope trace_scope((editor ? editor->trace() : 0), "sidebarPaint");
     QPainter p(this);
     p.fillRect(event->rect(), backgroundColor);
     p.setPen(lineNumberColor);
@@ -383,133 +2297,192 @@ MySQL_Editor_DocLayout::forceUpdate ( ) {
     emit documentSizeChanged(documentSize());
 }
 
+// MySQL word tables, constant data shared by all instances
+static const char * const MySQL_Keyword_Names[] = {
+    "ACCESS", "ADD", "ALL", "ALTER", "ANALYZE",
+    "AND", "AS", "ASC", "AUTO_INCREMENT", "BDB",
+    "BERKELEYDB", "BETWEEN", "BOTH", "BY", "CASCADE",
+    "CASE", "CHANGE", "CHARSET", "COLUMN", "COLUMNS",
+    "CONSTRAINT", "CREATE", "CROSS", "CURRENT_DATE", "CURRENT_TIME",
+    "CURRENT_TIMESTAMP", "DATABASE", "DATABASES", "DAY_HOUR", "DAY_MINUTE",
+    "DAY_SECOND", "DEC", "DEFAULT", "DELAYED", "DELETE",
+    "DESC", "DESCRIBE", "DISTINCT", "DISTINCTROW", "DROP",
+    "ELSE", "ENCLOSED", "ESCAPED", "EXISTS", "EXPLAIN",
+    "FIELDS", "FOR", "FOREIGN", "FROM", "FULL", "FULLTEXT",
+    "FUNCTION", "GRANT", "GROUP", "HAVING", "HIGH_PRIORITY",
+    "IF", "IGNORE", "IN", "INDEX", "INFILE",
+    "INNER", "INNODB", "INSERT", "INTERVAL", "INTO", "IS",
+    "JOIN", "KEY", "KEYS", "KILL", "LEADING",
+    "LEFT", "LIKE", "LIMIT", "LINES", "LOAD",
+    "LOCK", "LOW_PRIORITY", "MASTER_SERVER_ID", "MATCH", "MRG_MYISAM",
+    "NATIONAL", "NATURAL", "NOT", "NULL", "NUMERIC",
+    "ON", "OPTIMIZE", "OPTION", "OPTIONALLY", "OR",
+    "ORDER", "OUTER", "OUTFILE", "PARTIAL", "PRECISION",
+    "PRIMARY", "PRIVILEGES", "PROCEDURE", "PURGE", "READ",
+    "REFERENCES", "REGEXP", "RENAME", "REPLACE", "REQUIRE",
+    "RESTRICT", "RETURNS", "REVOKE", "RIGHT", "RLIKE",
+    "SELECT", "SET", "SHOW", "SONAME", "SQL_BIG_RESULT",
+    "SQL_CALC_FOUND_ROWS", "SQL_SMALL_RESULT", "SSL",
+    "STARTING", "STATUS", "STRAIGHT_JOIN",
+    "STRIPED", "TABLE", "TABLES", "TERMINATED", "THEN",
+    "TO", "TRAILING", "TRUNCATE", "TYPE", "UNION",
+    "UNIQUE", "UNLOCK", "UNSIGNED", "UPDATE", "USAGE",
+    "USE", "USER_RESOURCES", "USING", "VALUES", "VARYING",
+    "WHEN", "WHERE", "WHILE", "WITH", "WRITE",
+    "XOR", "YEAR_MONTH", "ZEROFILL"
+};
+
+static const char * const MySQL_Function_Names[] = {
+    // String functions
+    "ASCII", "BIN", "BIT_LENGTH", "CHAR", "CHARACTER_LENGTH",
+    "CHAR_LENGTH", "CONCAT", "CONCAT_WS", "CONV", "ELT",
+    "EXPORT_SET", "FIELD", "FIND_IN_SET", "HEX", "INSERT",
+    "INSTR", "LCASE", "LEFT", "LENGTH", "LOAD_FILE",
+    "LOCATE", "LOWER", "LPAD", "LTRIM", "MAKE_SET",
+    "MID", "OCT", "OCTET_LENGTH", "ORD", "POSITION",
+    "QUOTE", "REPEAT", "REPLACE", "REVERSE", "RIGHT",
+    "RPAD", "RTRIM", "SOUNDEX", "SPACE", "SUBSTRING",
+    "SUBSTRING_INDEX", "TRIM", "UCASE", "UPPER",
+    // Math functions
+    "ABS", "ACOS", "ASIN", "ATAN", "ATAN2",
+    "CEILING", "COS", "COT", "DEGREES", "EXP",
+    "FLOOR", "GREATEST", "LEAST", "LN", "LOG",
+    "LOG10", "LOG2", "MOD", "PI", "POW",
+    "POWER", "RADIANS", "RAND", "ROUND", "SIGN",
+    "SIN", "SQRT", "TAN",
+    // Date and time functions
+    "ADDDATE", "CURDATE", "CURRENT_DATE", "CURRENT_TIME", "CURRENT_TIMESTAMP",
+    "CURTIME", "DATE_ADD", "DATE_FORMAT", "DATE_SUB", "DAYNAME",
+    "DAYOFMONTH", "DAYOFWEEK", "DAYOFYEAR", "EXTRACT", "FROM_DAYS",
+    "FROM_UNIXTIME",
+    "NOW", "PERIOD_ADD", "PERIOD_DIFF", "QUARTER", "SECOND",
+    "SEC_TO_TIME", "SUBDATE", "SYSDATE", "TIME_FORMAT", "TIME_TO_SEC",
+    "TO_DAYS", "UNIX_TIMESTAMP", "WEEK", "WEEKDAY", "YEAR",
+    "YEARWEEK",
+    // Cast functions
+    "CAST", "CONVERT",
+    // Miscellaneous functions
+    "AES_DECRYPT", "AES_ENCRYPT", "BENCHMARK", "BIT_COUNT", "CONNECTION_ID",
+    "DATABASE", "DECODE", "DES_DECRYPT", "DES_ENCRYPT", "ENCODE",
+    "ENCRYPT", "FORMAT", "FOUND_ROWS", "GET_LOCK", "IFNULL",
+    "INET_ATON", "INET_NTOA", "ISNULL",
+    "IS_FREE_LOCK", "LAST_INSERT_ID", "MASTER_POS_WAIT", "MD5",
+    "PASSWORD", "RELEASE_LOCK", "SESSION_USER", "SHA", "SHA1",
+    "SYSTEM_USER", "USER", "VERSION",
+    // Aggregate functions
+    "AVG", "BIT_AND", "BIT_OR", "BIT_XOR", "COUNT", "GROUP_CONCAT",
+    "MAX", "MIN", "SEPARATOR", "STD", "STDDEV", "STDDEV_POP",
+    "STDDEV_SAMP", "SUM", "VAR_POP", "VAR_SAMP", "VARIANCE"
+};
+
+static const char * const MySQL_Type_Names[] = {
+    // String types
+    "BINARY", "BLOB", "CHAR", "CHARACTER", "ENUM",
+    "LONGBLOB", "LONGTEXT", "MEDIUMBLOB", "MEDIUMTEXT", "TEXT",
+    "TINYBLOB", "TINYTEXT", "VARBINARY", "VARCHAR", "SET",
+    // Numeric types
+    "BIGINT", "BIT", "BOOL", "BOOLEAN", "DEC",
+    "DECIMAL", "DOUBLE", "FIXED", "FLOAT", "INT",
+    "INTEGER", "LONG", "MEDIUMINT", "MIDDLEINT", "NUMERIC",
+    "TINYINT", "REAL", "SERIAL", "SMALLINT",
+    // Date and time types
+    "DATE", "DATETIME", "TIME", "TIMESTAMP", "YEAR"
+};
+
+static const char * const MySQL_Interval_Names[] = {
+    "MICROSECOND", "MINUTE", "HOUR", "DAY", "MONTH",
+    "SECOND_MICROSECOND", "MINUTE_MICROSECOND", "MINUTE_SECOND",
+    "HOUR_MICROSECOND", "HOUR_SECOND", "HOUR_MINUTE",
+    "DAY_MICROSECOND", "DAY_SECOND", "DAY_MINUTE", "DAY_HOUR",
+    "YEAR_MONTH"
+};
+
+static const char * const Newline_Word_Names[] = {
+    "SELECT", "UPDATE", "SET", "DELETE", "INSERT", "VALUES",
+    "FROM", "LEFT", "RIGHT", "INNER", "OUTER", "JOIN", "ON",
+    "UNION", "WHERE", "ORDER", "GROUP", "HAVING", "LIMIT"
+};
+
+static const char * const JOIN_Modifier_Names[] = {
+    "LEFT", "RIGHT", "INNER", "OUTER"
+};
+
+#define Word_Count(names) int(sizeof(names) / sizeof(names[0]))
+
+static QStringList
+Word_List ( const char * const *names,
+            int name_count ) {
+    QStringList word_list;
+    word_list.reserve(name_count);
+    for (int name_idx = 0; name_idx < name_count; name_idx += 1) word_list << QLatin1String(names[name_idx]);
+    return word_list;
+}
+
+// Dictionaries derived from the tables above, shared by all editors
+struct MySQL_Editor_Dictionaries {
+    MySQL_Editor_Dictionaries ( );
+
+    QStringList Keywords;
+    QStringList Functions;
+    QStringList Types;
+    QStringList Intervals;
+    QStringList All_Keywords;
+    QStringList Sorted_Keywords;
+    QStringList Newline_Words;
+    QStringList JOIN_Modifiers;
+    MySQL_Keyword_Table Keyword_Table;
+};
+
+MySQL_Editor_Dictionaries::MySQL_Editor_Dictionaries ( ) {
+    Keywords = Word_List(MySQL_Keyword_Names, Word_Count(MySQL_Keyword_Names));
+    Functions = Word_List(MySQL_Function_Names, Word_Count(MySQL_Function_Names));
+    Types = Word_List(MySQL_Type_Names, Word_Count(MySQL_Type_Names));
+    Intervals = Word_List(MySQL_Interval_Names, Word_Count(MySQL_Interval_Names));
+
+    All_Keywords << Keywords << Functions << Types << Intervals;
+    Sorted_Keywords = All_Keywords;
+    Sorted_Keywords.sort(Qt::CaseInsensitive);
+
+    Newline_Words = Word_List(Newline_Word_Names, Word_Count(Newline_Word_Names));
+    JOIN_Modifiers = Word_List(JOIN_Modifier_Names, Word_Count(JOIN_Modifier_Names));
+
+    Keyword_Table.insert(Keywords, MySQL_Keyword_Table::Keyword_Class);
+    Keyword_Table.insert(Functions, MySQL_Keyword_Table::Function_Class);
+    Keyword_Table.insert(Types, MySQL_Keyword_Table::Type_Class);
+    Keyword_Table.insert(Intervals, MySQL_Keyword_Table::Interval_Class);
+}
+
+Q_GLOBAL_STATIC(MySQL_Editor_Dictionaries, Editor_Dictionaries)
+
 MySQL_Editor::MySQL_Editor ( QWidget *parent ) : QPlainTextEdit( parent ) {
     Editor_Layout = new MySQL_Editor_DocLayout(document());
     Editor_Highlighter = new MySQL_Editor_Highlighter(document());
     // Highlighter can tokenize SQL, but can't distinguish ...
     // ... keywords, etc. from identifiers. Only one copy of these lists ...
-    // ... will be maintained (in the editor itself). The editor tokenizes ...
-    // ... SQL using a regular expression.
+    // ... will be maintained (in the editor itself). The editor reuses ...
+    // ... the highlighter's per-block tokens.
     Editor_Highlighter->setHighlightMySQLEditor(this);
     Editor_Sidebar = new MySQL_Editor_Sidebar(this);
+    Sidebar_Bracket_Generation = 0;
+    Sidebar_Fold_Unknown = false;
 
     // Default colors for these
     cursorColor = QColor(255, 255, 192);
     bracketMatchColor = QColor(96, 255, 96);
     bracketErrorColor= QColor(255, 96, 96);
-
-    MySQL_Keywords.clear();
-    MySQL_Keywords << "ACCESS" << "ADD" << "ALL" << "ALTER" << "ANALYZE";
-    MySQL_Keywords << "AND" << "AS" << "ASC" << "AUTO_INCREMENT" << "BDB";
-    MySQL_Keywords << "BERKELEYDB" << "BETWEEN" << "BOTH" << "BY" << "CASCADE";
-    MySQL_Keywords << "CASE" << "CHANGE" << "CHARSET" << "COLUMN" << "COLUMNS";
-    MySQL_Keywords << "CONSTRAINT" << "CREATE" << "CROSS" << "CURRENT_DATE" << "CURRENT_TIME";
-    MySQL_Keywords << "CURRENT_TIMESTAMP" << "DATABASE" << "DATABASES" << "DAY_HOUR" << "DAY_MINUTE";
-    MySQL_Keywords << "DAY_SECOND" << "DEC" << "DEFAULT" << "DELAYED" << "DELETE";
-    MySQL_Keywords << "DESC" << "DESCRIBE" << "DISTINCT" << "DISTINCTROW" << "DROP";
-    MySQL_Keywords << "ELSE" << "ENCLOSED" << "ESCAPED" << "EXISTS" << "EXPLAIN";
-    MySQL_Keywords << "FIELDS" << "FOR" << "FOREIGN" << "FROM" << "FULL" << "FULLTEXT";
-    MySQL_Keywords << "FUNCTION" << "GRANT" << "GROUP" << "HAVING" << "HIGH_PRIORITY";
-    MySQL_Keywords << "IF" << "IGNORE" << "IN" << "INDEX" << "INFILE";
-    MySQL_Keywords << "INNER" << "INNODB" << "INSERT" << "INTERVAL" << "INTO" << "IS";
-    MySQL_Keywords << "JOIN" << "KEY" << "KEYS" << "KILL" << "LEADING";
-    MySQL_Keywords << "LEFT" << "LIKE" << "LIMIT" << "LINES" << "LOAD";
-    MySQL_Keywords << "LOCK" << "LOW_PRIORITY" << "MASTER_SERVER_ID" << "MATCH" << "MRG_MYISAM";
-    MySQL_Keywords << "NATIONAL" << "NATURAL" << "NOT" << "NULL" << "NUMERIC";
-    MySQL_Keywords << "ON" << "OPTIMIZE" << "OPTION" << "OPTIONALLY" << "OR";
-    MySQL_Keywords << "ORDER" << "OUTER" << "OUTFILE" << "PARTIAL" << "PRECISION";
-    MySQL_Keywords << "PRIMARY" << "PRIVILEGES" << "PROCEDURE" << "PURGE" << "READ";
-    MySQL_Keywords << "REFERENCES" << "REGEXP" << "RENAME" << "REPLACE" << "REQUIRE";
-    MySQL_Keywords << "RESTRICT" << "RETURNS" << "REVOKE" << "RIGHT" << "RLIKE";
-    MySQL_Keywords << "SELECT" << "SET" << "SHOW" << "SONAME" << "SQL_BIG_RESULT";
-    MySQL_Keywords << "SQL_CALC_FOUND_ROWS" << "SQL_SMALL_RESULT" << "SSL";
-    MySQL_Keywords << "STARTING" << "STATUS" << "STRAIGHT_JOIN";
-    MySQL_Keywords << "STRIPED" << "TABLE" << "TABLES" << "TERMINATED" << "THEN";
-    MySQL_Keywords << "TO" << "TRAILING" << "TRUNCATE" << "TYPE" << "UNION";
-    MySQL_Keywords << "UNIQUE" << "UNLOCK" << "UNSIGNED" << "UPDATE" << "USAGE";
-    MySQL_Keywords << "USE" << "USER_RESOURCES" << "USING" << "VALUES" << "VARYING";
-    MySQL_Keywords << "WHEN" << "WHERE" << "WHILE" << "WITH" << "WRITE";
-    MySQL_Keywords << "XOR" << "YEAR_MONTH" << "ZEROFILL";
-
-    QStringList functions;
-    functions << "ASCII" << "BIN" << "BIT_LENGTH" << "CHAR" << "CHARACTER_LENGTH";
-    functions << "CHAR_LENGTH" << "CONCAT" << "CONCAT_WS" << "CONV" << "ELT";
-    functions << "EXPORT_SET" << "FIELD" << "FIND_IN_SET" << "HEX" << "INSERT";
-    functions << "INSTR" << "LCASE" << "LEFT" << "LENGTH" << "LOAD_FILE";
-    functions << "LOCATE" << "LOWER" << "LPAD" << "LTRIM" << "MAKE_SET";
-    functions << "MID" << "OCT" << "OCTET_LENGTH" << "ORD" << "POSITION";
-    functions << "QUOTE" << "REPEAT" << "REPLACE" << "REVERSE" << "RIGHT";
-    functions << "RPAD" << "RTRIM" << "SOUNDEX" << "SPACE" << "SUBSTRING";
-    functions << "SUBSTRING_INDEX" << "TRIM" << "UCASE" << "UPPER";
-
-    QStringList math_functions;
-    math_functions << "ABS" << "ACOS" << "ASIN" << "ATAN" << "ATAN2";
-    math_functions << "CEILING" << "COS" << "COT" << "DEGREES" << "EXP";
-    math_functions << "FLOOR" << "GREATEST" << "LEAST" << "LN" << "LOG";
-    math_functions << "LOG10" << "LOG2" << "MOD" << "PI" << "POW";
-    math_functions << "POWER" << "RADIANS" << "RAND" << "ROUND" << "SIGN";
-    math_functions << "SIN" << "SQRT" << "TAN";
-
-    QStringList date_time_functions;
-    date_time_functions << "ADDDATE" << "CURDATE" << "CURRENT_DATE" << "CURRENT_TIME" << "CURRENT_TIMESTAMP";
-    date_time_functions << "CURTIME" << "DATE_ADD" << "DATE_FORMAT" << "DATE_SUB" << "DAYNAME";
-    date_time_functions << "DAYOFMONTH" << "DAYOFWEEK" << "DAYOFYEAR" << "EXTRACT" << "FROM_DAYS";
-    date_time_functions << "FROM_UNIXTIME";
-    date_time_functions << "NOW" << "PERIOD_ADD" << "PERIOD_DIFF" << "QUARTER" << "SECOND";
-    date_time_functions << "SEC_TO_TIME" << "SUBDATE" << "SYSDATE" << "TIME_FORMAT" << "TIME_TO_SEC";
-    date_time_functions << "TO_DAYS" << "UNIX_TIMESTAMP" << "WEEK" << "WEEKDAY" << "YEAR";
-    date_time_functions << "YEARWEEK";
-
-    QStringList cast_functions;
-    cast_functions << "CAST" << "CONVERT";
-
-    QStringList misc_functions;
-    misc_functions << "AES_DECRYPT" << "AES_ENCRYPT" << "BENCHMARK" << "BIT_COUNT" << "CONNECTION_ID";
-    misc_functions << "DATABASE" << "DECODE" << "DES_DECRYPT" << "DES_ENCRYPT" << "ENCODE";
-    misc_functions << "ENCRYPT" << "FORMAT" << "FOUND_ROWS" << "GET_LOCK" << "IFNULL";
-    misc_functions << "INET_ATON" << "INET_NTOA" << "ISNULL";
-    misc_functions << "IS_FREE_LOCK" << "LAST_INSERT_ID" << "MASTER_POS_WAIT" << "MD5";
-    misc_functions << "PASSWORD" << "RELEASE_LOCK" << "SESSION_USER" << "SHA" << "SHA1";
-    misc_functions << "SYSTEM_USER" << "USER" << "VERSION";
-
-    QStringList aggregate_functions;
-    aggregate_functions << "AVG" << "BIT_AND" << "BIT_OR" << "BIT_XOR" << "COUNT" << "GROUP_CONCAT";
-    aggregate_functions << "MAX" << "MIN" << "SEPARATOR" << "STD" << "STDDEV" << "STDDEV_POP";
-    aggregate_functions << "STDDEV_SAMP" << "SUM" << "VAR_POP" << "VAR_SAMP" << "VARIANCE";
-
-    MySQL_Functions.clear();
-    MySQL_Functions << functions << math_functions << date_time_functions;
-    MySQL_Functions << cast_functions << misc_functions << aggregate_functions;
-
-    QStringList strings_types;
-    strings_types << "BINARY" << "BLOB" << "CHAR" << "CHARACTER" << "ENUM";
-    strings_types << "LONGBLOB" << "LONGTEXT" << "MEDIUMBLOB" << "MEDIUMTEXT" << "TEXT";
-    strings_types << "TINYBLOB" << "TINYTEXT" << "VARBINARY" << "VARCHAR" << "SET";
-
-    QStringList numeric_types;
-    numeric_types << "BIGINT" << "BIT" << "BOOL" << "BOOLEAN" << "DEC";
-    numeric_types << "DECIMAL" << "DOUBLE" << "FIXED" << "FLOAT" << "INT";
-    numeric_types << "INTEGER" << "LONG" << "MEDIUMINT" << "MIDDLEINT" << "NUMERIC";
-    numeric_types << "TINYINT" << "REAL" << "SERIAL" << "SMALLINT";
-
-    QStringList date_time_types;
-    date_time_types << "DATE" << "DATETIME" << "TIME" << "TIMESTAMP" << "YEAR";
-
-    MySQL_Types.clear();
-    MySQL_Types << strings_types << numeric_types << date_time_types;
-
-    QStringList date_time_intervals;
-    date_time_intervals << "MICROSECOND" << "MINUTE" << "HOUR" << "DAY" << "MONTH";
-    date_time_intervals << "SECOND_MICROSECOND" << "MINUTE_MICROSECOND" << "MINUTE_SECOND";
-    date_time_intervals << "HOUR_MICROSECOND" << "HOUR_SECOND" << "HOUR_MINUTE";
-    date_time_intervals << "DAY_MICROSECOND" << "DAY_SECOND" << "DAY_MINUTE" << "DAY_HOUR";
-    date_time_intervals << "YEAR_MONTH";
-
-    MySQL_Intervals.clear();
-    MySQL_Intervals << date_time_intervals;
-
-    All_MySQL_Keywords.clear();
-    All_MySQL_Keywords << MySQL_Keywords << MySQL_Functions << MySQL_Types << MySQL_Intervals;
+    markerColor = QColor(255, 255, 0);
+    Mark_Update_Queued = false;
+
+    // Built once per process, every instance shares the same (implicitly ...
+    // ... shared) lists and keyword table
+    const MySQL_Editor_Dictionaries *dictionaries = Editor_Dictionaries();
+    MySQL_Keywords = dictionaries->Keywords;
+    MySQL_Functions = dictionaries->Functions;
+    MySQL_Types = dictionaries->Types;
+    MySQL_Intervals = dictionaries->Intervals;
+    All_MySQL_Keywords = dictionaries->All_Keywords;
+    Sorted_MySQL_Keywords = dictionaries->Sorted_Keywords;
+    Keyword_Table = dictionaries->Keyword_Table;
 
     CodeFoldingEnabled = true;
     ShowLineNumbersEnabled = true;
@@ -522,6 +2495,30 @@ MySQL_Editor::MySQL_Editor ( QWidget *parent ) : QPlainTextEdit( parent ) {
     AutoCompleteKeywordsEnabled = false;
     AutoCompleteIdentifiersEnabled = false;
     In_Completion_Context = false;
+    Completion_Model = new MySQL_Completion_Model(this);
+    Context_Completion_Model = new MySQL_Completion_Model(this);
+    Completion_Model_Stale = true;
+
+    FuzzyCompletionEnabled = false;
+    Fuzzy_Completion_Model = new MySQL_Completion_Model(this);
+    Fuzzy_Completion_Watcher = new QFutureWatcher<QStringList>(this);
+    Fuzzy_Completion_Generation = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+    Fuzzy_Completion_Query_Generation = 0;
+    connect(Fuzzy_Completion_Watcher, SIGNAL(finished()), this, SLOT(onFuzzyCompletionReady()));
+
+    Find_Watcher = new QFutureWatcher<MySQL_Find_Result>(this);
+    Find_Generation = QSharedPointer<QAtomicInt>(new QAtomicInt(0));
+    Find_Query_Generation = 0;
+    Find_Revision = -1;
+    connect(Find_Watcher, SIGNAL(finished()), this, SLOT(onFindFinished()));
+
+    Schema_Provider = 0;
+    Static_Schema_Provider = new MySQL_Static_Schema_Provider(this);
+    Context_Identifier_Cache.setMaxCost(Default_Context_Identifier_Cache_Bytes);
+    Pending_Context_Position = -1;
+    Schema_Provider = Static_Schema_Provider;
+    connect(Schema_Provider, SIGNAL(contextIdentifiersReady(QString, QStringList)),
+            this, SLOT(onContextIdentifiersReady(QString, QStringList)));
 
     AutoUppercaseKeywordsEnabled = true;
 
@@ -550,62 +2547,38 @@ MySQL_Editor::MySQL_Editor ( QWidget *parent ) : QPlainTextEdit( parent ) {
 
     document()->setDocumentLayout(Editor_Layout);
 
-    connect(this, SIGNAL(textChanged()), this, SLOT(onTextChanged()));
-
     connect(this, SIGNAL(cursorPositionChanged()), this, SLOT(updateCursor()));
     connect(this, SIGNAL(cursorPositionChanged()), this, SLOT(onCursorPositionChanged()));
 
     connect(this, SIGNAL(blockCountChanged(int)), this, SLOT(updateSidebar()));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateHighlightPriority()));
+    connect(horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateHighlightPriority()));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateMarkSelections()));
+    connect(horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateMarkSelections()));
+    connect(Editor_Highlighter, SIGNAL(longLineHighlighted()), this, SLOT(onLongLineHighlighted()),
+            Qt::QueuedConnection);
     connect(this, SIGNAL(updateRequest(QRect, int)), this, SLOT(updateSidebar(QRect, int)));
+    connect(Editor_Highlighter, SIGNAL(deferredBlocksHighlighted()), this, SLOT(onDeferredBlocksHighlighted()));
 
-    QString doublequoted_string = "\"(?:[^\\\\\"]|\\\\.)*\"";
-    QString singlequoted_string = "'(?:[^\\\\']|\\\\.)*'";
-    QString c_style_comment = "/\\*(?:[^*]*|\\*[^/])*\\*/";
-    QString hash_comment = "#[^\\n]*\\n";
-    QString doubledash_comment = "--\\s+[^\\n]*\\n";
-    QString bracket_characters = QString("[") + QString(MySQL_Bracket_List) + QString("]");
-
-    MySQL_Bracket_RegEx =
-      QRegularExpression(doublequoted_string + "|" + singlequoted_string + "|" +
-                         c_style_comment + "|" + hash_comment + "|" + doubledash_comment + "|" +
-                         bracket_characters);
-
-    // QString identifier = "(?:`[^`]+`)|[A-Za-z0-9_$]+";
-    QString backticked_identifier = "`[^`]+`";
-
-    QString significant_punctuation = QString("[") + ",;" + QString("]");
-
-    // QString identifier_characters = "A-Za-z0-9_$";
-    // Note inclusion of '$', will not be present in keyword list
-    QString keyword_characters = "A-Za-z0-9_";
-    QString optional_keyword_delimiters = "[^" + keyword_characters + "]?";
-    // QString potential_keyword = ".?([A-Za-z_0-9]+).?";
-    QString potential_keyword =
-              optional_keyword_delimiters + "([" + keyword_characters + "]+)" + optional_keyword_delimiters;
-
-    // Some delimiters can potentially turn a keyword into a normal db object name, ...
-    // as for example in "SELECT * FROM database.table AS `table`".
-    QString sql_token_pattern =
-              doublequoted_string + "|" + singlequoted_string + "|" +
-              c_style_comment + "|" + hash_comment + "|" + doubledash_comment + "|" +
-              bracket_characters + "|" + significant_punctuation + "|" +
-              backticked_identifier + "|" + potential_keyword;
-
-    SQL_Token_Regular_Expression.setPattern(sql_token_pattern);
-
-    Newline_Word_List << "SELECT" << "UPDATE" << "SET" << "DELETE" << "INSERT" << "VALUES";
-    Newline_Word_List << "FROM" << "LEFT" << "RIGHT" << "INNER" << "OUTER" << "JOIN" << "ON";
-    Newline_Word_List << "UNION" << "WHERE" << "ORDER" << "GROUP" << "HAVING" << "LIMIT";
-    JOIN_Modifiers << "LEFT" << "RIGHT" << "INNER" << "OUTER";
+    Newline_Word_List = dictionaries->Newline_Words;
+    JOIN_Modifiers = dictionaries->JOIN_Modifiers;
 
     Previous_Cursor_Line = -1;
     Uppercasing_In_Process = false;
+    Uppercase_Pending = false;
+    Paste_In_Process = false;
+    Bulk_Edit_In_Process = false;
+
+    connect(document(), SIGNAL(contentsChange(int, int, int)), this, SLOT(onContentsChange(int, int, int)));
 
     Completer = new QCompleter(this);
     Completer->setModelSorting(QCompleter::CaseInsensitivelySortedModel);
     Completer->setCaseSensitivity(Qt::CaseInsensitive);
     Completer->setWrapAround(false);
     this->setCompleter(Completer);
+    // Let the popup lay out only the rows it shows
+    QListView *completer_popup = qobject_cast<QListView *>(Completer->popup());
+    if (completer_popup) completer_popup->setUniformItemSizes(true);
 
 #if defined(Q_OS_MAC)
     QFont textFont = font();
@@ -620,6 +2593,11 @@ MySQL_Editor::MySQL_Editor ( QWidget *parent ) : QPlainTextEdit( parent ) {
 }
 
 MySQL_Editor::~MySQL_Editor ( ) {
+    cancelFuzzyCompletion();
+    // Worker threads lex with this editor's keyword table
+    Editor_Highlighter->cancelParallelLexing();
+    cancelFind();
+    Find_Watcher->waitForFinished();
     delete Editor_Layout;
 }
 
@@ -667,147 +2645,179 @@ MySQL_Editor::mysqlIntervals ( ) const {
 
 bool
 MySQL_Editor::isKeyword ( QString potential_keyword ) {
-    return MySQL_Keywords.contains(potential_keyword);
+    return (Keyword_Table.classify(potential_keyword, Qt::CaseSensitive) & MySQL_Keyword_Table::Keyword_Class);
 }
 
 bool
 MySQL_Editor::isFunction ( QString potential_function ) {
-    return MySQL_Functions.contains(potential_function);
+    return (Keyword_Table.classify(potential_function, Qt::CaseSensitive) & MySQL_Keyword_Table::Function_Class);
 }
 
 
 bool
 MySQL_Editor::isType ( QString potential_type ) {
-    return MySQL_Types.contains(potential_type);
+    return (Keyword_Table.classify(potential_type, Qt::CaseSensitive) & MySQL_Keyword_Table::Type_Class);
 }
 
 
 bool
 MySQL_Editor::isInterval ( QString potential_interval ) {
-    return MySQL_Intervals.contains(potential_interval);
+    return (Keyword_Table.classify(potential_interval, Qt::CaseSensitive) & MySQL_Keyword_Table::Interval_Class);
 }
 
+int
+MySQL_Editor::classifyWord ( const QChar *word,
+                             int length ) const {
+    return Keyword_Table.classify(word, length);
+}
 
-QString
-MySQL_Editor::Compute_Bracket_Text ( QString Source_Text ) {
-    QString bracket_list = MySQL_Bracket_List;
-    QString bracket_text = QString(" ").repeated(Source_Text.length());
-    if (MySQL_Bracket_RegEx.isValid()) {
-        QRegularExpressionMatchIterator regex_iterator =
-                                          MySQL_Bracket_RegEx.globalMatch(Source_Text);
-        if (regex_iterator.hasNext()) {
-            // At least one found
-            while (regex_iterator.hasNext()) {
-                QRegularExpressionMatch match = regex_iterator.next();
-                if ((match.capturedLength() == 1) and
-                    bracket_list.contains(match.captured())) {
-                    bracket_text[match.capturedStart()] = match.captured().at(0);
-                }
-            }
-        }
+bool
+MySQL_Editor::isInsideStringOrComment ( int position ) {
+    // O(log n), finding the block plus a binary search of its token cache
+    QTextBlock block = document()->findBlock(position);
+    if (not block.isValid()) return false;
+    MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+    if (not block_data) return false;
+
+    int offset = position - block.position();
+    // Long lines may be lexed again around offset, outside their window
+    QVector<MySQL_Token> tokens = Editor_Highlighter->blockTokens(block, offset, offset);
+    // Find the last token starting at or before offset
+    int low_idx = 0;
+    int high_idx = tokens.count();
+    while (low_idx < high_idx) {
+        int middle_idx = (low_idx + high_idx) / 2;
+        if (tokens.at(middle_idx).offset <= offset) low_idx = middle_idx + 1;
+        else high_idx = middle_idx;
+    }
+    if (low_idx > 0) {
+        const MySQL_Token &token = tokens.at(low_idx - 1);
+        if (offset < (token.offset + token.length))
+            return ((token.token_class == MySQL_Token::String) or
+                    (token.token_class == MySQL_Token::Comment));
     }
-    return bracket_text;
+
+    // The newline ending a block is inside a comment that continues
+    int block_state = MySQL_Editor_Highlighter::lexicalState(block.userState());
+    return ((offset == (block.length() - 1)) and
+            (block_state == MySQL_Editor_Highlighter::Comment));
 }
 
+
 int
 MySQL_Editor::Bracket_Match_Position ( int Current_Position ) {
-    QString target_text = this->toPlainText();
+    MySQL_Counter_Scope counter_scope(Performance_Counters.Bracket_Matches, Performance_Counters.Bracket_Match_Nsecs);
+    // Bracket indexes of deferred blocks are empty or guessed. Lex up to ...
+    // ... the bracket, then on to the blocks the answer depends on until ...
+    // ... none of them is deferred. Usually one pass, nothing to lex.
+    QTextBlock needed_block = document()->findBlock(Current_Position);
+    if (not needed_block.isValid()) return -1;
+
+    int match_position = -1;
+    do {
+        Editor_Highlighter->finishPendingHighlighting(needed_block);
+        match_position = Lexed_Bracket_Match_Position(Current_Position, needed_block);
+    } while (Editor_Highlighter->hasPendingHighlighting(needed_block));
+    return match_position;
+}
 
-    if (not (target_text.length() == Bracket_Text.length())) onTextChanged();
-    if (not (target_text == Bracket_Source_Text)) onTextChanged();
+int
+MySQL_Editor::Lexed_Bracket_Match_Position ( int Current_Position,
+                                             QTextBlock &needed_block ) {
+    // Uses the per-block bracket index maintained by the highlighter, ...
+    // ... so brackets in strings and comments are never considered. ...
+    // ... Only the two end blocks are scanned, the depth tree skips the rest. ...
+    // ... needed_block is set to the last block the answer depends on, ...
+    // ... correct only if no block up to it is deferred.
+    QTextBlock block = document()->findBlock(Current_Position);
+    needed_block = block;
+    if (not block.isValid()) return -1;
+    MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+    if (not block_data) return -1;
+
+    int bracket_idx = block_data->bracketPositions.indexOf(Current_Position - block.position());
+    // For example, may have found bracket_list character in comment or string.
+    if (bracket_idx < 0) return -1;
 
     QString bracket_list = MySQL_Bracket_List;
+    int list_idx = bracket_list.indexOf(block_data->bracketCharacters.at(bracket_idx));
+    if (list_idx < 0) return -1;
+    int pair = list_idx / 2;
+    bool search_forward = ((list_idx % 2) == 0);
 
-    if ((Current_Position < 0) or (Current_Position >= target_text.length()) or
-        (Current_Position >= Bracket_Text.length())) return -1;
-    if (not bracket_list.contains(target_text.at(Current_Position))) return -1;
-
-    // For example, may have found bracket_list character in comment or string.
-    if (not (Bracket_Text.at(Current_Position) == target_text.at(Current_Position))) return -1;
-
-    int match_position = Current_Position;
     int paren_level = 0;
-    if (Bracket_Text.at(match_position) == '(') {
-        while (match_position < Bracket_Text.length()) {
-            if (Bracket_Text.at(match_position) == '(') paren_level += 1;
-            else if (Bracket_Text.at(match_position) == ')') paren_level -= 1;
-            if (paren_level == 0) break;
-            match_position += 1;
-        }
-    }
-    else if (Bracket_Text.at(match_position) == ')') {
-        while (match_position >= 0) {
-            if (Bracket_Text.at(match_position) == ')') paren_level += 1;
-            else if (Bracket_Text.at(match_position) == '(') paren_level -= 1;
-            if (paren_level == 0) break;
-            match_position -= 1;
-        }
-    }
-    else if (Bracket_Text.at(match_position) == '[') {
-        while (match_position < Bracket_Text.length()) {
-            if (Bracket_Text.at(match_position) == '[') paren_level += 1;
-            else if (Bracket_Text.at(match_position) == ']') paren_level -= 1;
-            if (paren_level == 0) break;
-            match_position += 1;
-        }
-    }
-    else if (Bracket_Text.at(match_position) == ']') {
-        while (match_position >= 0) {
-            if (Bracket_Text.at(match_position) == ']') paren_level += 1;
-            else if (Bracket_Text.at(match_position) == '[') paren_level -= 1;
-            if (paren_level == 0) break;
-            match_position -= 1;
-        }
+    int match_idx = MySQL_Bracket_Tree::scanBlock(block_data, pair, bracket_idx, search_forward, paren_level);
+    if (match_idx >= 0) return block.position() + block_data->bracketPositions.at(match_idx);
+    // Long lines index the brackets of their window only, the rest is unknown
+    if (block_data->Long_Line) return -1;
+
+    MySQL_Bracket_Tree *bracket_tree = Editor_Highlighter->bracketTree();
+    MySQLBlockData *match_data =
+      (search_forward ? bracket_tree->findForward(block_data, pair, paren_level) :
+                        bracket_tree->findBackward(block_data, pair, paren_level));
+    if (not match_data) {
+        // No match found, in any block after this one when searching forward
+        if (search_forward) needed_block = document()->lastBlock();
+        return -1;
     }
 
-    if ((match_position >= 0) and (match_position < Bracket_Text.length())) {
-        return match_position;
-    }
+    QTextBlock match_block = document()->findBlockByNumber(bracket_tree->blockNumber(match_data));
+    if (search_forward) needed_block = match_block;
+    if (not (reinterpret_cast<MySQLBlockData*>(match_block.userData()) == match_data)) return -1;
+    if (match_data->Long_Line) return -1;
+    match_idx = MySQL_Bracket_Tree::scanBlock(match_data, pair,
+                                              (search_forward ? 0 : (match_data->bracketPositions.count() - 1)),
+                                              search_forward, paren_level);
+    if (match_idx < 0) return -1;
 
-    return -1; // No match found
+    return match_block.position() + match_data->bracketPositions.at(match_idx);
 }
 
 int
-MySQL_Editor::Compute_Current_Paren_Indent ( QString Current_Text,
-                                             int Current_Position ) {
+MySQL_Editor::Compute_Current_Paren_Indent ( int Current_Position ) {
     // Returns paren_indent in units of spaces
-    QString bracket_text = Compute_Bracket_Text(Current_Text);
     // For example:
     // WHERE ((abc LIKE "%def%") OR <Return Here>
     // ... and then:
     // WHERE ((abc LIKE "%def%") OR
     //        <cursor>
-    int paren_indent = 0;
-    // Search back for closest unmatched "(", how is it "indented"?
-    int paren_level = 0;
-    int paren_position = Current_Position;
-    while (paren_position >= 0) {
-        if (bracket_text.at(paren_position) == QChar(')')) paren_level -= 1;
-        else if (bracket_text.at(paren_position) == QChar('(')) {
-            paren_level += 1;
-            if (paren_level == 1) {
-                // Found closest unmatched "(", now find immediately preceding newline
-                int newline_position = paren_position;
-                while ((newline_position >= 0) and
-                       (not (Current_Text.at(newline_position) == QChar('\n')))) newline_position -= 1;
-                // Found immediately preceding newline
-                if (((newline_position >= 0) and
-                     (Current_Text.at(newline_position) == QChar('\n'))) or
-                    // Start of text is also 'newline'
-                    (newline_position == -1)) {
-                    paren_indent = paren_position - newline_position;
-                    break;
-                }
-            }
-        }
-        paren_position -= 1;
+    if (Current_Position < 0) return 0;
+
+    QTextBlock block = document()->findBlock(Current_Position);
+    if (not block.isValid()) return 0;
+    // The search back reads the brackets of every block up to this one
+    Editor_Highlighter->finishPendingHighlighting(block);
+    MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+    if (not block_data) return 0;
+
+    // Search back for closest unmatched "(", how is it "indented"? ...
+    // ... As if a ")" followed Current_Position, find its match.
+    int pair = QString(MySQL_Bracket_List).indexOf(QChar('(')) / 2;
+    int bracket_idx = block_data->bracketPositions.count() - 1;
+    while ((bracket_idx >= 0) and
+           ((block.position() + block_data->bracketPositions.at(bracket_idx)) > Current_Position))
+        bracket_idx -= 1;
+
+    int paren_level = 1;
+    int paren_idx = MySQL_Bracket_Tree::scanBlock(block_data, pair, bracket_idx, false, paren_level);
+    if (paren_idx < 0) {
+        if (block_data->Long_Line) return 0;
+        MySQL_Bracket_Tree *bracket_tree = Editor_Highlighter->bracketTree();
+        block_data = bracket_tree->findBackward(block_data, pair, paren_level);
+        if (not (block_data and (not block_data->Long_Line))) return 0;
+        paren_idx = MySQL_Bracket_Tree::scanBlock(block_data, pair,
+                                                  (block_data->bracketPositions.count() - 1),
+                                                  false, paren_level);
+        if (paren_idx < 0) return 0;
     }
 
-    return paren_indent;
+    // Indent is the unmatched "(" column plus one
+    return block_data->bracketPositions.at(paren_idx) + 1;
 }
 
 void
 MySQL_Editor::keyPressEvent ( QKeyEvent* event ) {
+    MySQL_Trace_Scope trace_scope(&Editor_Trace, "keyPressEvent");
     static QString part_of_word("abcdefghijklmnopqrstuvwxyz_0123456789");
     static QString end_of_word("~!@#$%^&*()_+{}|:\"<>?,./;'[]\\-=");
 
@@ -818,6 +2828,8 @@ MySQL_Editor::keyPressEvent ( QKeyEvent* event ) {
         // The following keys are forwarded by QCompleter to the widget
         switch (event->key()) {
            case Qt::Key_Escape:
+               cancelFuzzyCompletion();
+               Pending_Context_Identifier.clear();
                // Return to normal completion (exit context)
                if (In_Completion_Context) initializeAutoComplete();
                In_Completion_Context = false;
@@ -841,6 +2853,7 @@ MySQL_Editor::keyPressEvent ( QKeyEvent* event ) {
             (event->text().isEmpty() or
              end_of_word.contains(event->text().right(1).toLower()) or
              (not part_of_word.contains(event->text().right(1).toLower())))) {
+            cancelFuzzyCompletion();
             Completer->popup()->hide();
             // A 'completion context' is entered when a context indetifier is followed by '.', ...
             // for example, 'table_name.' in which case all of the column names in table_name ...
@@ -857,13 +2870,22 @@ MySQL_Editor::keyPressEvent ( QKeyEvent* event ) {
 
             if (((not In_Completion_Context) and (completionPrefix.length() < 3)) or
                 (In_Completion_Context and (completionPrefix.length() < 1))) {
+                cancelFuzzyCompletion();
                 if (Completer->popup()->isVisible()) Completer->popup()->hide();
             }
+            else if (FuzzyCompletionEnabled and (not In_Completion_Context)) {
+                // Ranked on a worker thread, popped up by onFuzzyCompletionReady
+                requestFuzzyCompletion(completionPrefix);
+            }
             else {
                 if (not (completionPrefix == Completer->completionPrefix())) {
+                    // Narrow the model to the prefix range before QCompleter filters it
+                    if (In_Completion_Context) Context_Completion_Model->setPrefix(completionPrefix);
+                    else Completion_Model->setPrefix(completionPrefix);
                     Completer->setCompletionPrefix(completionPrefix);
                     Completer->popup()->setCurrentIndex(Completer->completionModel()->index(0, 0));
                 }
+                MySQL_Trace_Scope popup_trace_scope(&Editor_Trace, "completionPopup");
                 QRect cur_rect = cursorRect();
                 cur_rect.setWidth(Completer->popup()->sizeHintForColumn(0) +
                                   Completer->popup()->verticalScrollBar()->sizeHint().width());
@@ -920,8 +2942,6 @@ MySQL_Editor::keyPressEvent ( QKeyEvent* event ) {
     }
     else if ((event->key() == Qt::Key_Return) and AutoIndentEnabled) {
         QTextCursor txt_cursor = QPlainTextEdit::textCursor();
-        QString before_cursor_text = QPlainTextEdit::toPlainText();
-        before_cursor_text.truncate(txt_cursor.position());
 
         // For example:
         // SELECT abc
@@ -932,8 +2952,7 @@ MySQL_Editor::keyPressEvent ( QKeyEvent* event ) {
         // FROM
         // (SELECT def AS abc
         //  FROM
-        int paren_indent = Compute_Current_Paren_Indent(before_cursor_text,
-                                                        (before_cursor_text.length() - 1));
+        int paren_indent = Compute_Current_Paren_Indent(txt_cursor.position() - 1);
 
         // For example:
         // SELECT abc
@@ -992,12 +3011,8 @@ MySQL_Editor::keyPressEvent ( QKeyEvent* event ) {
                     word_boundary_idx =
                       previous_line_text_before_cursor.lastIndexOf(QRegularExpression("(?<=\\s)[^\\s]"),
                                                                    (cursor_position_on_line - 1));
-                    if (word_boundary_idx < 0) {
-                        QString before_cursor_text = QPlainTextEdit::toPlainText();
-                        before_cursor_text.truncate(cursor_position);
-                        word_boundary_idx = Compute_Current_Paren_Indent(before_cursor_text,
-                                                                         (before_cursor_text.length() - 1));
-                    }
+                    if (word_boundary_idx < 0)
+                        word_boundary_idx = Compute_Current_Paren_Indent(cursor_position - 1);
                 }
                 if (not (word_boundary_idx == cursor_position_on_line)) {
                     txt_cursor.movePosition(QTextCursor::StartOfLine, QTextCursor::KeepAnchor);
@@ -1048,25 +3063,18 @@ MySQL_Editor::keyPressEvent ( QKeyEvent* event ) {
             txt_cursor.movePosition(QTextCursor::PreviousWord);
             txt_cursor.select(QTextCursor::WordUnderCursor);
             QString context_identifier = txt_cursor.selectedText();
-            if (Auto_Complete_Context_Identifier_List.contains(context_identifier)) {
-                QStringList word_list;
-                word_list << Auto_Complete_Context_Identifier_List[context_identifier];
-                // In a context, leave word-List in database order
-                // word_list.sort(Qt::CaseInsensitive);
-                Completer->setModel(new QStringListModel(word_list));
-                // A 'completion context' is entered when a context indetifier is followed by '.', ...
-                // for example, 'table_name.' in which case all of the column names in table_name ...
-                // ... are displayed in the completer popup.
-                In_Completion_Context = true;
-
-                Completer->setCompletionPrefix("");
-                Completer->popup()->setCurrentIndex(Completer->completionModel()->index(0, 0));
-
-                QRect cur_rect = cursorRect();
-                cur_rect.setWidth(Completer->popup()->sizeHintForColumn(0) +
-                                  Completer->popup()->verticalScrollBar()->sizeHint().width());
-                Completer->complete(cur_rect); // popup it up!
-
+            QStringList *identifiers = Context_Identifier_Cache.object(context_identifier);
+            if (Schema_Catalog and Schema_Catalog->hasContext(context_identifier)) {
+                showContextCompletion(Schema_Catalog->contextIdentifiers(context_identifier), QString());
+            }
+            else if (identifiers) {
+                if (not identifiers->isEmpty()) showContextCompletion(*identifiers, QString());
+            }
+            else if (Schema_Provider and (not context_identifier.isEmpty())) {
+                // Popped up by onContextIdentifiersReady, once the '.' is in place
+                Pending_Context_Identifier = context_identifier;
+                Pending_Context_Position = QPlainTextEdit::textCursor().position() + 1;
+                Schema_Provider->requestContextIdentifiers(context_identifier);
             }
         }
         // Allow parent class (normal) handling of key
@@ -1130,38 +3138,79 @@ MySQL_Editor::Indent_Selected_Text_Lines ( int Indent_Tab_Modulus ) {
     QPlainTextEdit::setTextCursor(new_txt_cursor);
 }
 
+#define Paste_Chunk_Characters (1024 * 1024)
+
 void
 MySQL_Editor::insertFromMimeData ( const QMimeData* source ) {
     if (source->hasText()) {
         QString paste_text = source->text();
-        // Convert tab characters into tab modulus spaces
-        paste_text = paste_text.replace("\t", QString(" ").repeated(Tab_Modulus));
-        QStringList paste_lines = paste_text.split("\n");
-        if (paste_lines.count() == 1) {
+        if (paste_text.length() <= Paste_Chunk_Characters) {
+            // Convert tab characters into tab modulus spaces
+            paste_text = paste_text.replace("\t", QString(" ").repeated(Tab_Modulus));
+            // Since we don't format, just paste and be done
             QPlainTextEdit::insertPlainText(paste_text);
         }
         else {
-            // Indent pasted text intelligently ...
-            // int initial_position = QPlainTextEdit::textCursor().position();
-
-            // QPlainTextEdit::insertPlainText(paste_text);
-
-            // QTextCursor txt_cursor = QPlainTextEdit::textCursor();
-            // txt_cursor.setPosition(initial_position, QTextCursor::KeepAnchor);
-            // QPlainTextEdit::setTextCursor(txt_cursor);
-            // // ... using general formatting code
-            // // Format_Selected_Text_Lines();
-
-            // Since we don't format, just paste and be done
-            QPlainTextEdit::insertPlainText(paste_text);
+            insertPlainTextInChunks(paste_text);
         }
     }
 }
 
 void
-MySQL_Editor::onTextChanged ( ) {
-    Bracket_Source_Text = this->toPlainText();
-    Bracket_Text = Compute_Bracket_Text(Bracket_Source_Text);
+MySQL_Editor::insertPlainTextInChunks ( const QString &paste_text ) {
+    // Huge pastes, such as a dump. Tabs are converted a chunk at a time ...
+    // ... and the chunks inserted in one edit block, one undo step. The ...
+    // ... document signals, relayouts and rehighlights once, at the end, ...
+    // ... with deferred highlighting taking care of the rest.
+    QString tab_spaces = QString(" ").repeated(Tab_Modulus);
+    QTextCursor paste_cursor = textCursor();
+    Paste_In_Process = true;
+    paste_cursor.beginEditBlock();
+    int chunk_start = 0;
+    while (chunk_start < paste_text.length()) {
+        int chunk_end = qMin(paste_text.length(), chunk_start + Paste_Chunk_Characters);
+        // Never split a surrogate pair, nor a "\r\n" which would become two newlines
+        while ((chunk_end < paste_text.length()) and
+               (paste_text.at(chunk_end - 1).isHighSurrogate() or (paste_text.at(chunk_end - 1) == '\r')))
+            chunk_end += 1;
+        QString chunk = paste_text.mid(chunk_start, chunk_end - chunk_start);
+        paste_cursor.insertText(chunk.replace("\t", tab_spaces));
+        chunk_start = chunk_end;
+    }
+    paste_cursor.endEditBlock();
+    Paste_In_Process = false;
+    setTextCursor(paste_cursor);
+}
+
+void
+MySQL_Editor::onContentsChange ( int position,
+                                 int chars_removed,
+                                 int chars_added ) {
+    Q_UNUSED(chars_removed)
+    MySQL_Counter_Scope counter_scope(Performance_Counters.Contents_Changes, Performance_Counters.Contents_Change_Nsecs);
+    // Marks are redone once the layout caught up with the edit
+    if ((not Mark_String.isEmpty()) and (not Mark_Update_Queued)) {
+        Mark_Update_Queued = true;
+        QMetaObject::invokeMethod(this, "updateMarkSelections", Qt::QueuedConnection);
+    }
+    // Our own replacements need no second pass, nor do bulk edits and ...
+    // ... streamed pastes, uppercasing a whole dump on the next line ...
+    // ... change is not wanted
+    if (Uppercasing_In_Process or Bulk_Edit_In_Process or Paste_In_Process) return;
+
+    // Accumulate the edited range, the cursor's anchor and position ...
+    // ... follow later insertions and removals automatically.
+    int dirty_start = position;
+    int dirty_end = position + chars_added;
+    if (Uppercase_Pending) {
+        dirty_start = qMin(dirty_start, Uppercase_Dirty_Range.selectionStart());
+        dirty_end = qMax(dirty_end, Uppercase_Dirty_Range.selectionEnd());
+    }
+    int document_end = qMax(0, document()->characterCount() - 1);
+    Uppercase_Dirty_Range = QTextCursor(document());
+    Uppercase_Dirty_Range.setPosition(qMin(dirty_start, document_end));
+    Uppercase_Dirty_Range.setPosition(qMin(dirty_end, document_end), QTextCursor::KeepAnchor);
+    Uppercase_Pending = true;
 }
 
 void
@@ -1169,13 +3218,14 @@ MySQL_Editor::onCursorPositionChanged ( ) {
     QTextCursor text_cursor = this->textCursor();
     int cursor_line = text_cursor.blockNumber();
 
-    if (AutoUppercaseKeywordsEnabled) {
+    if (AutoUppercaseKeywordsEnabled and Uppercase_Pending and
+        (not (Uppercasing_In_Process or Bulk_Edit_In_Process or Paste_In_Process))) {
         if (not (cursor_line == Previous_Cursor_Line)) {
-            // int previous_line_ch_idx = SQL_Editor->positionFromLineIndex(Previous_Cursor_Line, 0);
-            // int previous_line_length = SQL_Editor->lineLength(Previous_Cursor_Line);
-
-            // Uppercase_SQL_Keywords(previous_line_ch_idx, previous_line_length);
-            Uppercase_SQL_Keywords(0, 0);
+            // Only the blocks edited since the last pass, ...
+            // ... merely moving the cursor costs nothing.
+            Uppercase_Pending = false;
+            int dirty_start = Uppercase_Dirty_Range.selectionStart();
+            Uppercase_SQL_Keywords(dirty_start, qMax(1, Uppercase_Dirty_Range.selectionEnd() - dirty_start));
         }
     }
 
@@ -1188,114 +3238,91 @@ MySQL_Editor::Uppercase_SQL_Keywords ( int start_uppercase_position,
     // start_uppercase_position and uppercase_length < 0, only selection
     // start_uppercase_position and uppercase_length == 0, entire sql text
     if (Uppercasing_In_Process) return;
+    MySQL_Counter_Scope counter_scope(Performance_Counters.Uppercase_Passes, Performance_Counters.Uppercase_Nsecs);
+    MySQL_Trace_Scope trace_scope(&Editor_Trace, "Uppercase_SQL_Keywords");
 
     Uppercasing_In_Process = true;
 
     // Save cursor position so that it can be restored, ...
     // ... this operation MUST NOT move the cursor.
     QTextCursor text_cursor = this->textCursor();
+    int cursor_anchor = text_cursor.anchor();
+    int cursor_position = text_cursor.position();
 
-    QString sql_text;
-    int sql_text_position;
-    int sql_text_length;
-    bool inside_c_style_comment = false;
-
-    int first_modified_position = INT_MAX;
-    int last_modified_position = -1;
+    QTextBlock first_block = document()->begin();
+    QTextBlock last_block = document()->lastBlock();
+    int range_start = 0;
+    int range_end = INT_MAX;
+    // Long lines are lexed again around this range only
+    int lex_start = 0;
+    int lex_end = INT_MAX;
 
     if ((start_uppercase_position < 0) or (uppercase_length < 0)) {
         // Operate on selection only
-        sql_text = this->Selected_Text();
-        sql_text_position = 0;
-        sql_text_length = sql_text.length();
+        range_start = text_cursor.selectionStart();
+        range_end = text_cursor.selectionEnd();
+        lex_start = range_start;
+        lex_end = range_end;
+        first_block = document()->findBlock(range_start);
+        last_block = document()->findBlock(range_end);
     }
-    else {
-        sql_text = this->toPlainText();
-        if ((start_uppercase_position == 0) and (uppercase_length == 0)) {
-            // Operate on entire content
-            sql_text_position = 0;
-            sql_text_length = sql_text.length();
-        }
-        else {
-            // Operate on bounded portion only
-            sql_text_position = start_uppercase_position;
-            sql_text_length = uppercase_length;
-        }
-
-        QRegExp c_style_comment_delimiter("/\\*|\\*/");
-        int delimiter_idx = sql_text.lastIndexOf(c_style_comment_delimiter, sql_text_position);
-        if (delimiter_idx >= 0) {
-            QString delimiter = c_style_comment_delimiter.cap(0);
-            if (delimiter == "/*") {
-                inside_c_style_comment = true;
-            }
-        }
+    else if (not ((start_uppercase_position == 0) and (uppercase_length == 0))) {
+        // Operate on bounded portion only, extended to whole blocks
+        lex_start = start_uppercase_position;
+        lex_end = start_uppercase_position + uppercase_length;
+        first_block = document()->findBlock(start_uppercase_position);
+        last_block = document()->findBlock(start_uppercase_position + uppercase_length);
     }
-
-    if (not inside_c_style_comment) {
-        int sql_text_idx = sql_text_position;
-        bool modified = false;
-
-        while  ((sql_text_idx >= 0) and
-                (sql_text_idx <= (sql_text_position + sql_text_length))) {
-            QRegularExpressionMatch uppercase_keyword_match =
-                                      SQL_Token_Regular_Expression.match(sql_text, sql_text_idx);
-            int word_idx = uppercase_keyword_match.capturedStart();
-            if (word_idx >= 0) {
-                int new_sql_text_idx = uppercase_keyword_match.capturedEnd();
-                QString word = uppercase_keyword_match.captured(1);
-                if (word.length() > 0) {
-                    QString entire_word_capture = uppercase_keyword_match.captured(0);
-                    QString delimiters = "`.";
-                    // These delimiters can turn a keyword into a normal db object name, ...
-                    // as for example in "SELECT * FROM database.table AS `table`".
-                    bool leading_delimiter = delimiters.contains(entire_word_capture.left(1));
-                    bool trailing_delimiter = delimiters.contains(entire_word_capture.right(1));
-                    if (All_MySQL_Keywords.contains(word.toUpper()) and
-                        (not (word == word.toUpper())) and
-                        (not leading_delimiter) and
-                        (not trailing_delimiter)) {
-                        int word_index = uppercase_keyword_match.capturedStart(1);
-                        sql_text.replace(word_index, word.length(), word.toUpper());
-                        if (word_index < first_modified_position) first_modified_position = word_index;
-                        if ((word_index + word.length()) > last_modified_position)
-                            last_modified_position = word_index + word.length();
-                        modified = true;
-                    }
-
-                    if ((entire_word_capture.left(1) == "`") and
-                        (entire_word_capture.right(1) == "`"))
-                        // "FROM `database.table`" is not valid, treat "`name`" as atomic, ...
-                        // ... i.e. any "`" pertains to exactly one identifier and must enclose it.
-                        sql_text_idx = new_sql_text_idx;
-                    else if (entire_word_capture.right(1) == ".")
-                        // But if trailing delimiter is ".", ...
-                        // ... it better be next word's leading delimiter, ...
-                        // ... as in "FROM database.table", for example.
-                        sql_text_idx = new_sql_text_idx - 1;
-                    else
-                        sql_text_idx = new_sql_text_idx;
+    // Otherwise operate on entire content
+    if (not first_block.isValid()) first_block = document()->lastBlock();
+    if (not last_block.isValid()) last_block = document()->lastBlock();
+    // Deferred blocks have no tokens yet or tokens lexed from a guessed ...
+    // ... entry state, lex every block up to the end of the range first
+    Editor_Highlighter->finishPendingHighlighting(last_block);
+
+    // Keyword tokens come from the highlighter's per-block cache, which ...
+    // ... already knows about strings, comments, backticks and qualification ...
+    // ... as for example in "SELECT * FROM database.table AS `table`".
+    QList<int> keyword_positions;
+    QStringList uppercase_keywords;
+    for (QTextBlock block = first_block; block.isValid(); block = block.next()) {
+        MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+        if (block_data) {
+            QString block_text;
+            QVector<MySQL_Token> tokens = Editor_Highlighter->blockTokens(block,
+                                                                          lex_start - block.position(),
+                                                                          lex_end - block.position());
+            foreach (const MySQL_Token &token, tokens) {
+                if (not token.isKeywordClass()) continue;
+                int word_position = block.position() + token.offset;
+                if ((word_position < range_start) or
+                    ((word_position + token.length) > range_end)) continue;
+                if (block_text.isEmpty()) block_text = block.text();
+                QString word = block_text.mid(token.offset, token.length);
+                if (not (word == word.toUpper())) {
+                    keyword_positions << word_position;
+                    uppercase_keywords << word.toUpper();
                 }
-                else sql_text_idx = new_sql_text_idx;
             }
-            else sql_text_idx = -1;
         }
+        if (block == last_block) break;
+    }
 
-        if (modified) {
-            if ((start_uppercase_position < 0) or (uppercase_length < 0))
-                this->insertPlainText(sql_text);
-            else {
-                // Replace modified portion only, why bother with the rest?
-                QTextCursor modified_cursor = this->textCursor();
-                modified_cursor.setPosition(first_modified_position);
-                modified_cursor.setPosition(last_modified_position, QTextCursor::KeepAnchor);
-                this->setTextCursor(modified_cursor);
-                this->insertPlainText(sql_text.mid(first_modified_position,
-                                                   (last_modified_position - first_modified_position)));
-            }
-            // Cursor position should not have changed
-            this->setTextCursor(text_cursor);
+    if (not keyword_positions.isEmpty()) {
+        // Replace modified words only, why bother with the rest?
+        QTextCursor modified_cursor(document());
+        modified_cursor.beginEditBlock();
+        for (int keyword_idx = 0; keyword_idx < keyword_positions.count(); keyword_idx += 1) {
+            modified_cursor.setPosition(keyword_positions.at(keyword_idx));
+            modified_cursor.setPosition(keyword_positions.at(keyword_idx) + uppercase_keywords.at(keyword_idx).length(),
+                                        QTextCursor::KeepAnchor);
+            modified_cursor.insertText(uppercase_keywords.at(keyword_idx));
         }
+        modified_cursor.endEditBlock();
+        // Lengths are unchanged, so is the cursor position
+        text_cursor.setPosition(cursor_anchor);
+        text_cursor.setPosition(cursor_position, QTextCursor::KeepAnchor);
+        this->setTextCursor(text_cursor);
     }
 
     Uppercasing_In_Process = false;
@@ -1306,44 +3333,13 @@ MySQL_Editor::Initial_SQL_Keyword ( QString SQL_Statement ) {
     // The initial keyword defines the statement type ...
     // ... (for example, data fetch only vs data modify) and ...
     // ... may only be preceded by a comment.
-    int sql_statement_idx = 0;
-    int sql_statement_length = SQL_Statement.count();
-
-    while  ((sql_statement_idx >= 0) and
-            (sql_statement_idx <= sql_statement_length)) {
-        QRegularExpressionMatch sql_token_match =
-                                  SQL_Token_Regular_Expression.match(SQL_Statement, sql_statement_idx);
-        int word_idx = sql_token_match.capturedStart();
-        if (word_idx >= 0) {
-            int new_sql_statement_idx = sql_token_match.capturedEnd();
-            QString word = sql_token_match.captured(1);
-            if (word.length() > 0) {
-                QString entire_word_capture = sql_token_match.captured(0);
-                QString delimiters = "`.";
-                // These delimiters can turn a keyword into a normal db object name, ...
-                // as for example in "SELECT * FROM database.table AS `table`".
-                bool leading_delimiter = delimiters.contains(entire_word_capture.left(1));
-                bool trailing_delimiter = delimiters.contains(entire_word_capture.right(1));
-                if (All_MySQL_Keywords.contains(word.toUpper()) and
-                    (not leading_delimiter) and
-                    (not trailing_delimiter)) return word.toUpper(); // Return first keyword
-
-                if ((entire_word_capture.left(1) == "`") and
-                    (entire_word_capture.right(1) == "`"))
-                    // "FROM `database.table`" is not valid, treat "`name`" as atomic, ...
-                    // ... i.e. any "`" pertains to exactly one identifier and must enclose it.
-                    sql_statement_idx = new_sql_statement_idx;
-                else if (entire_word_capture.right(1) == ".")
-                    // But if trailing delimiter is ".", ...
-                    // ... it better be next word's leading delimiter, ...
-                    // ... as in "FROM database.table", for example.
-                    sql_statement_idx = new_sql_statement_idx - 1;
-                else
-                    sql_statement_idx = new_sql_statement_idx;
-            }
-            else sql_statement_idx = new_sql_statement_idx;
-        }
-        else sql_statement_idx = -1;
+    // SQL_Statement need not be in the document, so tokenize it with ...
+    // ... the highlighter's lexer rather than reading the block cache.
+    QVector<MySQL_Token> tokens;
+    MySQL_Editor_Highlighter::lexText(SQL_Statement, MySQL_Editor_Highlighter::Start, this, tokens);
+    foreach (const MySQL_Token &token, tokens) {
+        if (token.isKeywordClass())
+            return SQL_Statement.mid(token.offset, token.length).toUpper(); // Return first keyword
     }
 
     return ""; // No keyword found
@@ -1351,6 +3347,7 @@ MySQL_Editor::Initial_SQL_Keyword ( QString SQL_Statement ) {
 
 void
 MySQL_Editor::Simple_Format_SQL ( ) {
+    MySQL_Trace_Scope trace_scope(&Editor_Trace, "Simple_Format_SQL");
     // Not intended to significantly beautify the SQL, ...
     // ... but merely to make single-line SQLs more readable.
     // Significant beautification requires a full parse of the SQL into tokens.
@@ -1359,97 +3356,61 @@ MySQL_Editor::Simple_Format_SQL ( ) {
     // ... because, unless the SQL were fully parsed, it would be ...
     // ... difficult to determine what condition grouping would be implied ...
     // ... by operator precedence.
+    // The per-block tokens must be complete
+    Editor_Highlighter->finishPendingHighlighting();
     QString sql_text = this->toPlainText();
     int sql_text_length = sql_text.length();
 
-    // QString doublequoted_string = "\"(?:[^\\\\\"]|\\\\.)*\"";
-    // QString singlequoted_string = "'(?:[^\\\\']|\\\\.)*'";
-    // QString c_style_comment = "/\\*(?:[^*]*|\\*[^/])*\\*/";
-    // QString hash_comment = "#[^\\n]*\\n";
-    // QString doubledash_comment = "--\\s+[^\\n]*\\n";
-    // QString keyword_characters = "A-Za-z_0-9";
-    // QString significant_punctuation = "(,);";
-    // QString optional_keyword_delimiters = "[^" + keyword_characters + significant_punctuation + "]?";
-    // QString potential_keyword =
-    //           optional_keyword_delimiters + "([" + keyword_characters + "]+)" + optional_keyword_delimiters;
-    // QString significant_token_pattern =
-    //             doublequoted_string + "|" + singlequoted_string + "|" +
-    //             c_style_comment + "|" + hash_comment + "|" + doubledash_comment + "|" +
-    //             "[" + significant_punctuation + "]" + "|" +
-    //             potential_keyword;
-
-    // QRegularExpression significant_token_rx(significant_token_pattern);
-    // Some delimiters can potentially turn a keyword into a normal db object name, ...
-    // ... as for example in "SELECT * FROM database.table AS `table`", ...
-    // ... where "`" and "." are delimiters.
-    QString significant_punctuation = QString(MySQL_Bracket_List) + ",;";
-
     // Search SQL text begin-to-end saving tokens requiring either ...
     // ... preceding or succeeding newlines. The key will be the position and ...
     // ... the value will be the token's text.
     QMap <int, QString> insert_newline_tokens;
-    int sql_text_idx = 0;
-    bool modified = false;
     int paren_level = 0;
+    // Edits to apply to the document, in order: position, characters ...
+    // ... replaced and replacement. sql_text gets the same edits, as the ...
+    // ... newline checks look at the text as edited so far.
+    QList<int> edit_positions;
+    QList<int> edit_lengths;
+    QStringList edit_texts;
     QStringList newline_after_tokens; newline_after_tokens << "," << "VALUES";
 
     QStringList comma_newline_words; comma_newline_words << "SELECT" << "VALUES";
     QString current_newline_word = "";
 
-    while  ((sql_text_idx >= 0) and
-            (sql_text_idx <= sql_text_length)) {
-        QRegularExpressionMatch significant_token_match =
-                                  SQL_Token_Regular_Expression.match(sql_text, sql_text_idx);
-        int word_idx = significant_token_match.capturedStart();
-        if (word_idx >= 0) {
-            int new_sql_text_idx = significant_token_match.capturedEnd();
-            QString token_capture = significant_token_match.captured(0);
-            QString word = significant_token_match.captured(1);
-            if (significant_punctuation.contains(token_capture)) {
-                if (token_capture == "(") paren_level = paren_level + 1;
-                else if (token_capture == ")") paren_level = paren_level - 1;
-                else if (token_capture == ",") {
+    // Tokens come from the highlighter's per-block cache. Keyword classes ...
+    // ... already exclude words made into db object names by delimiters, ...
+    // ... as for example in "SELECT * FROM database.table AS `table`".
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+        if (not block_data) continue;
+        foreach (const MySQL_Token &token, Editor_Highlighter->blockTokens(block)) {
+            int word_index = block.position() + token.offset;
+            if (token.token_class == MySQL_Token::Bracket) {
+                if (sql_text.at(word_index) == '(') paren_level = paren_level + 1;
+                else if (sql_text.at(word_index) == ')') paren_level = paren_level - 1;
+            }
+            else if (token.token_class == MySQL_Token::Operator) {
+                if (sql_text.at(word_index) == ',') {
                     if ((paren_level == 0) and
                         comma_newline_words.contains(current_newline_word))
-                        insert_newline_tokens[word_idx] = token_capture;
+                        insert_newline_tokens[word_index] = ",";
                 }
-                sql_text_idx = new_sql_text_idx;
             }
-            else if (word.length() > 0) {
-                QString delimiters = "`.";
-                // These delimiters can turn a keyword into a normal db object name, ...
-                // as for example in "SELECT * FROM database.table AS `table`".
-                bool leading_delimiter = delimiters.contains(token_capture.left(1));
-                bool trailing_delimiter = delimiters.contains(token_capture.right(1));
-                if (All_MySQL_Keywords.contains(word.toUpper()) and
-                    (not leading_delimiter) and
-                    (not trailing_delimiter)) {
-                    int word_index = significant_token_match.capturedStart(1);
-                    if (not (word == word.toUpper())) {
-                        sql_text.replace(word_index, word.length(), word.toUpper());
-                        modified = true;
-                    }
-                    if (Newline_Word_List.contains(word.toUpper())) {
-                        current_newline_word = word.toUpper();
-                        insert_newline_tokens[word_index] = word.toUpper();
-                    }
+            else if (token.isKeywordClass()) {
+                QString word = sql_text.mid(word_index, token.length);
+                // Same length, so positions of later edits hold
+                if ((not (word == word.toUpper())) and (word.toUpper().length() == word.length())) {
+                    sql_text.replace(word_index, word.length(), word.toUpper());
+                    edit_positions << word_index;
+                    edit_lengths << word.length();
+                    edit_texts << word.toUpper();
+                }
+                if (Newline_Word_List.contains(word.toUpper())) {
+                    current_newline_word = word.toUpper();
+                    insert_newline_tokens[word_index] = word.toUpper();
                 }
-
-                if ((token_capture.left(1) == "`") and (token_capture.right(1) == "`"))
-                    // "FROM `database.table`" is not valid, treat "`name`" as atomic, ...
-                    // ... i.e. any "`" pertains to exactly one identifier and must enclose it.
-                    sql_text_idx = new_sql_text_idx;
-                else if (token_capture.right(1) == ".")
-                    // But if trailing delimiter is ".", ...
-                    // ... it better be next word's leading delimiter, ...
-                    // ... as in "FROM database.table", for example.
-                    sql_text_idx = new_sql_text_idx - 1;
-                else
-                    sql_text_idx = new_sql_text_idx;
             }
-            else sql_text_idx = new_sql_text_idx;
         }
-        else sql_text_idx = -1;
     }
 
     if (insert_newline_tokens.count() > 0) {
@@ -1464,7 +3425,8 @@ MySQL_Editor::Simple_Format_SQL ( ) {
             }
         }
         // Step backward through insert required newline tokens so that ...
-        // ... preceding positions (the key) remain valid despite newline insertions
+        // ... preceding positions (the key) remain valid despite newline insertions. ...
+        // ... Likewise for the document, where the insertions are replayed in this order.
         for (int token_idx = (newline_index.count() - 1);
              token_idx >= 0; token_idx = token_idx - 1) {
             QString current_token = insert_newline_tokens[newline_index[token_idx]];
@@ -1494,7 +3456,9 @@ MySQL_Editor::Simple_Format_SQL ( ) {
                         insert_newline += "       ";
                     }
                     sql_text.insert(ch_idx, insert_newline);
-                    modified = true;
+                    edit_positions << ch_idx;
+                    edit_lengths << 0;
+                    edit_texts << insert_newline;
                 }
             }
             if (newline_index[token_idx] > 0) {
@@ -1517,7 +3481,9 @@ MySQL_Editor::Simple_Format_SQL ( ) {
                         // No immediately preceding newline found, insert one
                         if (not found_newline) {
                             sql_text.insert(newline_index[token_idx], "\n");
-                            modified = true;
+                            edit_positions << newline_index[token_idx];
+                            edit_lengths << 0;
+                            edit_texts << "\n";
                         }
                     }
                 }
@@ -1525,16 +3491,22 @@ MySQL_Editor::Simple_Format_SQL ( ) {
         }
     }
 
-    if (modified) {
-        // "Note that the undo/redo history is cleared by this function."
-        // this->setText(sql_text);
-
-        this->Set_PlainText(sql_text);
-
-        // Cursor position probably changed, no point computing, set to origin
-        QTextCursor text_cursor = this->textCursor();
-        text_cursor.setPosition(0);
-        this->setTextCursor(text_cursor);
+    if (not edit_positions.isEmpty()) {
+        // Small edits in one edit block, rather than replacing the whole ...
+        // ... text: only the touched blocks are relaid out and rehighlighted, ...
+        // ... highlight states and folds elsewhere survive, and the undo ...
+        // ... step holds just the edits. The cursor follows its text.
+        Bulk_Edit_In_Process = true;
+        QTextCursor edit_cursor(document());
+        edit_cursor.beginEditBlock();
+        for (int edit_idx = 0; edit_idx < edit_positions.count(); edit_idx += 1) {
+            edit_cursor.setPosition(edit_positions.at(edit_idx));
+            edit_cursor.setPosition(edit_positions.at(edit_idx) + edit_lengths.at(edit_idx),
+                                    QTextCursor::KeepAnchor);
+            edit_cursor.insertText(edit_texts.at(edit_idx));
+        }
+        edit_cursor.endEditBlock();
+        Bulk_Edit_In_Process = false;
     }
 }
 
@@ -1566,6 +3538,9 @@ MySQL_Editor::setColor ( ColorComponent component,
     } else if (component == BracketError) {
         bracketErrorColor= color;
         updateCursor();
+    } else if (component == Marker) {
+        markerColor = color;
+        updateMarkSelections();
     } else if (component == FoldIndicator) {
         Editor_Sidebar->foldIndicatorColor = color;
         updateSidebar();
@@ -1646,13 +3621,7 @@ MySQL_Editor::isCodeFoldingEnabled ( ) const {
 
 bool
 MySQL_Editor::isFoldable ( int line ) {
-    int matchPos = findClosingConstruct(document()->findBlockByNumber(line - 1));
-    if (matchPos >= 0) {
-        QTextBlock matchBlock = document()->findBlock(matchPos);
-        if (matchBlock.isValid() && matchBlock.blockNumber() > line)
-            return true;
-    }
-    return false;
+    return findFoldEndBlock(document()->findBlockByNumber(line - 1)) >= 0;
 }
 
 bool
@@ -1668,11 +3637,18 @@ MySQL_Editor::isFolded ( int line ) const {
 
 void
 MySQL_Editor::fold ( int line ) {
+    MySQL_Trace_Scope trace_scope(&Editor_Trace, "fold");
     QTextBlock startBlock = document()->findBlockByNumber(line - 1);
-    int endPos = findClosingConstruct(startBlock);
-    if (endPos < 0)
+    int endBlockNumber = findFoldEndBlock(startBlock);
+    if ((endBlockNumber < 0) && Editor_Highlighter->hasPendingHighlighting()) {
+        // Unknown while a block up to the fold end is deferred
+        Editor_Highlighter->finishPendingHighlighting();
+        endBlockNumber = findFoldEndBlock(startBlock);
+    }
+    if (endBlockNumber < 0)
         return;
-    QTextBlock endBlock = document()->findBlock(endPos);
+    QTextBlock endBlock = document()->findBlockByNumber(endBlockNumber);
+    int endPos = endBlock.position();
 
     QTextBlock block = startBlock.next();
     while (block.isValid() && block != endBlock) {
@@ -1691,8 +3667,9 @@ MySQL_Editor::fold ( int line ) {
 
 void
 MySQL_Editor::unfold ( int line ) {
+    MySQL_Trace_Scope trace_scope(&Editor_Trace, "unfold");
     QTextBlock startBlock = document()->findBlockByNumber(line - 1);
-    int endPos = findClosingConstruct(startBlock);
+    int endPos = startBlock.position() + startBlock.length();
 
     QTextBlock block = startBlock.next();
     while (block.isValid() && !block.isVisible()) {
@@ -1719,31 +3696,216 @@ MySQL_Editor::toggleFold ( int line ) {
 }
 
 int
-MySQL_Editor::findClosingConstruct ( const QTextBlock &block ) {
+MySQL_Editor::findFoldEndBlock ( const QTextBlock &block ) {
+    // Fold region of a block, from the block to the one closing its first ...
+    // ... unmatched Open_Fold_Bracket. Cached in the block data and recomputed ...
+    // ... at most once per bracket tree generation, so repaints are O(1) ...
+    // ... per line. Deferred highlighting changes brackets without ...
+    // ... changing the document revision, the generation follows both.
     if (!block.isValid())
         return -1;
     MySQLBlockData *blockData = reinterpret_cast<MySQLBlockData*>(block.userData());
     if (!blockData)
         return -1;
-    if (blockData->bracketPositions.isEmpty())
+    uint bracket_generation = Editor_Highlighter->bracketTree()->generation();
+    if (blockData->Fold_Generation == bracket_generation)
+        return blockData->Fold_End_Block;
+
+    blockData->Fold_Generation = bracket_generation;
+    blockData->Fold_End_Block = -1;
+    // Long lines index the brackets of their window only
+    if (blockData->Long_Line)
         return -1;
-    const QTextDocument *doc = block.document();
-    int offset = block.position();
-    foreach (int pos, blockData->bracketPositions) {
-        int absPos = offset + pos;
-        if (doc->characterAt(absPos) == Open_Fold_Bracket) {
-            int matchPos = Bracket_Match_Position(absPos); // findClosingMatch(doc, absPos);
-            if (matchPos >= 0)
-                return matchPos;
-        }
+
+    int pair = QString(MySQL_Bracket_List).indexOf(QChar(Open_Fold_Bracket)) / 2;
+    const MySQL_Bracket_Summary &summary = blockData->Block_Summary[pair];
+    // No bracket left open at the end of the block, nothing to fold
+    if ((summary.net - summary.min_prefix) <= 0)
+        return -1;
+
+    // First unmatched open bracket follows the last point of lowest depth
+    int depth = 0;
+    int first_open_idx = 0;
+    for (int bracket_idx = 0; bracket_idx < blockData->bracketCharacters.length(); bracket_idx += 1) {
+        QChar bracket = blockData->bracketCharacters.at(bracket_idx);
+        if (bracket == Open_Fold_Bracket) depth += 1;
+        else if (bracket == Close_Fold_Bracket) depth -= 1;
+        else continue;
+        if (depth == summary.min_prefix) first_open_idx = bracket_idx + 1;
     }
-    return -1;
+    while ((first_open_idx < blockData->bracketCharacters.length()) and
+           (not (blockData->bracketCharacters.at(first_open_idx) == Open_Fold_Bracket)))
+        first_open_idx += 1;
+    if (first_open_idx >= blockData->bracketCharacters.length())
+        return -1;
+
+    // Painting must not lex, while a block up to the match is still ...
+    // ... deferred the fold is unknown and not cached. Lexing it changes ...
+    // ... the generation or emits deferredBlocksHighlighted, either repaints.
+    QTextBlock neededBlock;
+    int matchPos = Lexed_Bracket_Match_Position(block.position() + blockData->bracketPositions.at(first_open_idx),
+                                                neededBlock);
+    if (Editor_Highlighter->hasPendingHighlighting(neededBlock)) {
+        blockData->Fold_Generation = bracket_generation - 1;
+        Sidebar_Fold_Unknown = true;
+        return -1;
+    }
+    if (matchPos < 0)
+        return -1;
+    int matchBlockNumber = document()->findBlock(matchPos).blockNumber();
+    // Blocks strictly between start and end are hidden, there must be at least one
+    if (matchBlockNumber > (block.blockNumber() + 1))
+        blockData->Fold_End_Block = matchBlockNumber;
+    return blockData->Fold_End_Block;
 }
 
 void
 MySQL_Editor::resizeEvent ( QResizeEvent *event ) {
     QPlainTextEdit::resizeEvent(event);
     updateSidebar();
+    updateHighlightPriority();
+    updateMarkSelections();
+}
+
+void
+MySQL_Editor::setLargeDocumentHighlighting ( int block_threshold,
+                                             int slice_budget_msecs ) {
+    // Documents above block_threshold blocks (never if < 0) are highlighted ...
+    // ... viewport first, then in idle-time slices of slice_budget_msecs
+    Editor_Highlighter->setDeferredHighlighting(block_threshold, slice_budget_msecs);
+}
+
+void
+MySQL_Editor::setLongLineThreshold ( int line_threshold ) {
+    // Lines above line_threshold characters (never if < 0) are highlighted ...
+    // ... around the visible columns only, and turn wrapping off
+    Editor_Highlighter->setLongLineThreshold(line_threshold);
+}
+
+MySQL_Editor_Counters
+MySQL_Editor::performanceCounters ( ) const {
+    // Highlighting is counted by the highlighter, the rest here
+    MySQL_Editor_Counters counters = Performance_Counters;
+    const MySQL_Editor_Counters &highlight_counters = Editor_Highlighter->counters();
+    counters.Highlighted_Blocks = highlight_counters.Highlighted_Blocks;
+    counters.Highlighted_Characters = highlight_counters.Highlighted_Characters;
+    counters.Highlight_Nsecs = highlight_counters.Highlight_Nsecs;
+    return counters;
+}
+
+void
+MySQL_Editor::resetPerformanceCounters ( ) {
+    Performance_Counters = MySQL_Editor_Counters();
+    Editor_Highlighter->resetCounters();
+}
+
+MySQL_Editor_Trace *
+MySQL_Editor::trace ( ) {
+    return &Editor_Trace;
+}
+
+QTextCursor
+MySQL_Editor::statementAt ( int position ) {
+    // O(log n), finding the block, then the neighbouring statement ends ...
+    // ... through the depth tree's counts. The statement is the one whose ...
+    // ... delimiter ends at or after position, so a cursor just past a ...
+    // ... delimiter picks the statement before it.
+    Editor_Highlighter->finishPendingHighlighting();
+    QTextBlock block = document()->findBlock(position);
+    if (not block.isValid()) return QTextCursor();
+    MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+    if (not block_data) return QTextCursor();
+
+    MySQL_Bracket_Tree *bracket_tree = Editor_Highlighter->bracketTree();
+    int offset = position - block.position();
+    int statement_idx = bracket_tree->statementsBefore(block_data);
+    foreach (const MySQL_Statement_End &statement_end, block_data->Statement_Ends) {
+        if (statement_end.resume >= offset) break;
+        statement_idx += 1;
+    }
+
+    int start_position = 0;
+    int end_position = document()->characterCount() - 1;
+    int block_statement_idx = 0;
+    MySQLBlockData *end_data = bracket_tree->findStatement(statement_idx, block_statement_idx);
+    if (end_data) {
+        QTextBlock end_block = document()->findBlockByNumber(bracket_tree->blockNumber(end_data));
+        if (reinterpret_cast<MySQLBlockData*>(end_block.userData()) == end_data)
+            end_position = end_block.position() + end_data->Statement_Ends.at(block_statement_idx).offset;
+    }
+    MySQLBlockData *start_data = ((statement_idx > 0) ?
+                                  bracket_tree->findStatement(statement_idx - 1, block_statement_idx) : 0);
+    if (start_data) {
+        QTextBlock start_block = document()->findBlockByNumber(bracket_tree->blockNumber(start_data));
+        if (reinterpret_cast<MySQLBlockData*>(start_block.userData()) == start_data)
+            start_position = start_block.position() + start_data->Statement_Ends.at(block_statement_idx).resume;
+    }
+    return statementCursor(start_position, end_position);
+}
+
+QList<QTextCursor>
+MySQL_Editor::statements ( ) {
+    // Every statement in document order, empty ones left out
+    Editor_Highlighter->finishPendingHighlighting();
+    QList<QTextCursor> statement_cursors;
+    int start_position = 0;
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+        if (not block_data) continue;
+        foreach (const MySQL_Statement_End &statement_end, block_data->Statement_Ends) {
+            QTextCursor statement_cursor = statementCursor(start_position, block.position() + statement_end.offset);
+            if (statement_cursor.hasSelection()) statement_cursors << statement_cursor;
+            start_position = block.position() + statement_end.resume;
+        }
+    }
+    QTextCursor statement_cursor = statementCursor(start_position, document()->characterCount() - 1);
+    if (statement_cursor.hasSelection()) statement_cursors << statement_cursor;
+    return statement_cursors;
+}
+
+QTextCursor
+MySQL_Editor::statementCursor ( int start_position,
+                                int end_position ) {
+    // Selects start_position to end_position, less surrounding white space
+    while ((start_position < end_position) and document()->characterAt(start_position).isSpace())
+        start_position += 1;
+    while ((end_position > start_position) and document()->characterAt(end_position - 1).isSpace())
+        end_position -= 1;
+    QTextCursor statement_cursor(document());
+    statement_cursor.setPosition(start_position);
+    statement_cursor.setPosition(end_position, QTextCursor::KeepAnchor);
+    return statement_cursor;
+}
+
+void
+MySQL_Editor::updateHighlightPriority ( ) {
+    // The visible blocks plus a page above and below
+    int page_blocks = (viewport()->height() / qMax(1, fontMetrics().height())) + 1;
+    int first_visible = firstVisibleBlock().blockNumber();
+    Editor_Highlighter->setPriorityWindow(first_visible - page_blocks, first_visible + (2 * page_blocks));
+
+    // The visible columns, estimated from the average character width ...
+    // ... as laying out a multi-megabyte line to ask is what we avoid
+    int char_width = qMax(1, fontMetrics().averageCharWidth());
+    int first_column = horizontalScrollBar()->value() / char_width;
+    Editor_Highlighter->setHorizontalWindow(first_column, first_column + (viewport()->width() / char_width));
+}
+
+void
+MySQL_Editor::onLongLineHighlighted ( ) {
+    // Wrapping lays out the whole line at every width change, keep ...
+    // ... it off while long lines are around. TextWrapEnabled is kept.
+    if (not (lineWrapMode() == NoWrap)) setLineWrapMode(NoWrap);
+}
+
+void
+MySQL_Editor::onDeferredBlocksHighlighted ( ) {
+    // Fold markers of the visible blocks may depend on blocks just lexed
+    if (Sidebar_Fold_Unknown or
+        (not (Sidebar_Bracket_Generation == Editor_Highlighter->bracketTree()->generation()))) {
+        Sidebar_Fold_Unknown = false;
+        updateSidebar();
+    }
 }
 
 void
@@ -1766,13 +3928,16 @@ MySQL_Editor::wheelEvent ( QWheelEvent *event ) {
 void
 MySQL_Editor::updateCursor ( ) {
     if (isReadOnly()) {
-        setExtraSelections(QList<QTextEdit::ExtraSelection>());
+        setExtraSelections(Mark_Selections);
     } else {
 
         matchPositions.clear();
         errorPositions.clear();
 
-        if (BracketsMatchingEnabled) {
+        MySQLBlockData *cursor_block_data = reinterpret_cast<MySQLBlockData*>(textCursor().block().userData());
+        // Long lines index the brackets of their window only, which may ...
+        // ... lag behind the cursor, don't report errors that aren't
+        if (BracketsMatchingEnabled and not (cursor_block_data and cursor_block_data->Long_Line)) {
             QTextCursor cursor = textCursor();
             int cursorPosition = cursor.position();
 
@@ -1826,6 +3991,7 @@ MySQL_Editor::updateCursor ( ) {
             extraSelections.append(errorHighlight);
         }
 
+        extraSelections += Mark_Selections;
         setExtraSelections(extraSelections);
     }
 }
@@ -1834,12 +4000,18 @@ void
 MySQL_Editor::updateSidebar ( const QRect &rect,
                               int d ) {
     Q_UNUSED(rect)
-    if (d != 0)
+    // Fold markers also change as deferred highlighting indexes brackets, ...
+    // ... without the document scrolling or changing
+    if ((d != 0) or
+        (not (Sidebar_Bracket_Generation == Editor_Highlighter->bracketTree()->generation())))
         updateSidebar();
 }
 
 void
 MySQL_Editor::updateSidebar ( ) {
+    MySQL_Counter_Scope counter_scope(Performance_Counters.Sidebar_Updates, Performance_Counters.Sidebar_Nsecs);
+    MySQL_Trace_Scope trace_scope(&Editor_Trace, "updateSidebar");
+    Sidebar_Bracket_Generation = Editor_Highlighter->bracketTree()->generation();
     if ((not ShowLineNumbersEnabled) and (not CodeFoldingEnabled)) {
         Editor_Sidebar->hide();
         setViewportMargins(0, 0, 0, 0);
@@ -1881,9 +4053,9 @@ MySQL_Editor::updateSidebar ( ) {
                 Editor_Sidebar->lineNumbers[index].position = rect.top();
                 Editor_Sidebar->lineNumbers[index].number = block.blockNumber() + 1;
                 Editor_Sidebar->lineNumbers[index].foldable =
-                  CodeFoldingEnabled ? isFoldable(block.blockNumber() + 1) : false;
+                  CodeFoldingEnabled ? (findFoldEndBlock(block) >= 0) : false;
                 Editor_Sidebar->lineNumbers[index].folded =
-                  CodeFoldingEnabled ? isFolded(block.blockNumber() + 1) : false;
+                  CodeFoldingEnabled ? (block.next().isValid() and (not block.next().isVisible())) : false;
                 ++index;
             }
             if (rect.top() > sidebarRect.bottom())
@@ -1895,24 +4067,216 @@ MySQL_Editor::updateSidebar ( ) {
     Editor_Sidebar->update();
 }
 
+void
+MySQL_Editor::updateMarkSelections ( ) {
+    Mark_Update_Queued = false;
+    if (Mark_String.isEmpty() and Mark_Selections.isEmpty()) return;
+
+    Mark_Selections.clear();
+    if (not Mark_String.isEmpty()) {
+        QTextCharFormat marker_format;
+        marker_format.setBackground(markerColor);
+        marker_format.setForeground(palette().color(QPalette::Text));
+
+        // Long lines are searched in the visible columns only, estimated ...
+        // ... as in updateHighlightPriority
+        int mark_length = Mark_String.length();
+        int char_width = qMax(1, fontMetrics().averageCharWidth());
+        int first_column = horizontalScrollBar()->value() / char_width;
+        int last_column = first_column + (viewport()->width() / char_width);
+        QRectF viewport_rect = viewport()->rect();
+
+        QTextBlock block = firstVisibleBlock();
+        while (block.isValid()) {
+            if (block.isVisible()) {
+                QRectF rect = blockBoundingGeometry(block).translated(contentOffset());
+                if (rect.top() > viewport_rect.bottom())
+                    break;
+
+                MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+                QString text;
+                int text_offset = 0;
+                if (block_data and block_data->Long_Line) {
+                    int block_length = block.length() - 1;
+                    text_offset = qBound(0, first_column - mark_length, block_length);
+                    QTextCursor fragment_cursor(block);
+                    fragment_cursor.setPosition(block.position() + text_offset);
+                    fragment_cursor.setPosition(block.position() + qMin(block_length, last_column + mark_length),
+                                                QTextCursor::KeepAnchor);
+                    text = fragment_cursor.selectedText();
+                } else {
+                    text = block.text();
+                }
+
+                int pos = Mark_Matcher.indexIn(text, 0);
+                while (pos >= 0) {
+                    QTextEdit::ExtraSelection mark_highlight;
+                    mark_highlight.format = marker_format;
+                    mark_highlight.cursor = QTextCursor(block);
+                    mark_highlight.cursor.setPosition(block.position() + text_offset + pos);
+                    mark_highlight.cursor.setPosition(block.position() + text_offset + pos + mark_length,
+                                                      QTextCursor::KeepAnchor);
+                    Mark_Selections.append(mark_highlight);
+                    pos = Mark_Matcher.indexIn(text, pos + 1);
+                }
+            }
+            block = block.next();
+        }
+    }
+    updateCursor();
+}
+
 void
 MySQL_Editor::mark ( const QString &str,
                      Qt::CaseSensitivity sens ) {
-    Editor_Highlighter->mark(str, sens);
+    // Only the visible matches are looked for, an overlay of extra ...
+    // ... selections redone as the view scrolls
+    Mark_String = str;
+    Mark_Matcher.setPattern(str);
+    Mark_Matcher.setCaseSensitivity(sens);
+    updateMarkSelections();
+}
+
+void
+MySQL_Editor::findAll ( const QString &pattern,
+                        bool regular_expression,
+                        Qt::CaseSensitivity sens,
+                        bool skip_strings_and_comments ) {
+    Find_Options.Pattern = pattern;
+    Find_Options.Regular_Expression = regular_expression;
+    Find_Options.Case_Sensitivity = sens;
+    Find_Options.Skip_Strings_And_Comments = skip_strings_and_comments;
+    Find_Options.Replace = false;
+    Find_Options.Replacement.clear();
+    startFind();
+}
+
+void
+MySQL_Editor::replaceAll ( const QString &replacement ) {
+    Find_Options.Replace = true;
+    Find_Options.Replacement = replacement;
+    startFind();
+}
+
+void
+MySQL_Editor::cancelFind ( ) {
+    Find_Generation->fetchAndAddOrdered(1);
+}
+
+bool
+MySQL_Editor::isFinding ( ) const {
+    return Find_Watcher->isRunning();
+}
+
+const MySQL_Find_Result &
+MySQL_Editor::findResult ( ) const {
+    return Find_Result;
+}
+
+void
+MySQL_Editor::startFind ( ) {
+    // Supersede (cancel) any search in flight, its matches are dropped
+    Find_Query_Generation = Find_Generation->fetchAndAddOrdered(1) + 1;
+    Find_Result = MySQL_Find_Result();
+
+    // Matches never span lines, nor can a plain pattern that would
+    bool valid_pattern = (not Find_Options.Pattern.isEmpty());
+    if (Find_Options.Regular_Expression)
+        valid_pattern = valid_pattern and QRegularExpression(Find_Options.Pattern).isValid();
+    else
+        valid_pattern = valid_pattern and (not Find_Options.Pattern.contains('\n'));
+    if (not valid_pattern) {
+        if (Find_Options.Replace) emit replaceFinished(-1);
+        else emit findFinished(-1);
+        return;
+    }
+
+    Find_Revision = document()->revision();
+    Find_Watcher->setFuture(QtConcurrent::run(Find_All_In_Parallel,
+                                              toPlainText(),
+                                              Find_Options,
+                                              static_cast<const MySQL_Editor *>(this),
+                                              Find_Generation,
+                                              Find_Query_Generation));
+}
+
+void
+MySQL_Editor::onFindFinished ( ) {
+    // Canceled, or superseded by a newer search
+    if (not (Find_Generation->loadAcquire() == Find_Query_Generation)) return;
+
+    MySQL_Find_Result find_result = Find_Watcher->result();
+    find_result.Revision = Find_Revision;
+    if (not Find_Options.Replace) {
+        Find_Result = find_result;
+        emit findFinished(Find_Result.Matches.count());
+        return;
+    }
+
+    // Edited while searching, the positions are stale
+    if (not (Find_Revision == document()->revision())) {
+        startFind();
+        return;
+    }
+
+    MySQL_Trace_Scope trace_scope(&Editor_Trace, "replaceAll");
+    // Spliced runs of matches, or one edit per match
+    const QVector<MySQL_Find_Match> &edits =
+      (find_result.Replace_Spans.isEmpty() ? find_result.Matches : find_result.Replace_Spans);
+    QTextCursor replace_cursor(document());
+    Bulk_Edit_In_Process = true;
+    replace_cursor.beginEditBlock();
+    // Last edit first, the earlier positions stay valid
+    for (int edit_idx = edits.count() - 1; edit_idx >= 0; edit_idx -= 1) {
+        const MySQL_Find_Match &edit = edits.at(edit_idx);
+        replace_cursor.setPosition(edit.position);
+        replace_cursor.setPosition(edit.position + edit.length, QTextCursor::KeepAnchor);
+        replace_cursor.insertText(edit.replacement);
+    }
+    replace_cursor.endEditBlock();
+    Bulk_Edit_In_Process = false;
+    emit replaceFinished(find_result.Matches.count());
 }
 
 // Auto complete ...
 void
 MySQL_Editor::initializeAutoComplete ( ) {
+    cancelFuzzyCompletion();
+
     if (AutoCompleteKeywordsEnabled or AutoCompleteIdentifiersEnabled) {
-        QStringList word_list;
+        // Only re-sort when the word lists changed, leaving a context just ...
+        // ... switches back to the persistent model
+        if (Completion_Model_Stale and Schema_Catalog and AutoCompleteIdentifiersEnabled) {
+            // Sorted and merged by the catalog, once for all editors sharing it
+            MySQL_Counter_Scope counter_scope(Performance_Counters.Completion_Model_Builds,
+                                              Performance_Counters.Completion_Model_Nsecs);
+            Completion_Model->setWords(Schema_Catalog->completionWords(AutoCompleteKeywordsEnabled ?
+                                                                       Sorted_MySQL_Keywords : QStringList()),
+                                       true);
+            Completion_Model_Stale = false;
+        }
+        else if (Completion_Model_Stale) {
+            MySQL_Counter_Scope counter_scope(Performance_Counters.Completion_Model_Builds,
+                                              Performance_Counters.Completion_Model_Nsecs);
+            QStringList word_list;
 
-        if (AutoCompleteKeywordsEnabled) word_list << All_MySQL_Keywords;
-        if (AutoCompleteIdentifiersEnabled) word_list << Auto_Complete_Identifier_List;
+            if (AutoCompleteKeywordsEnabled) word_list << All_MySQL_Keywords;
+            if (AutoCompleteIdentifiersEnabled) word_list << Auto_Complete_Identifier_List;
 
-        word_list.sort(Qt::CaseInsensitive);
+            word_list.sort(Qt::CaseInsensitive);
+
+            Completion_Model->setWords(word_list, true);
+            Completion_Model_Stale = false;
+        }
+        else {
+            Completion_Model->setPrefix(QString());
+        }
 
-        Completer->setModel(new QStringListModel(word_list));
+        if (not (Completer->model() == Completion_Model)) {
+            Completer->setModel(Completion_Model);
+            Completer->setModelSorting(QCompleter::CaseInsensitivelySortedModel);
+            Completer->setCompletionMode(QCompleter::PopupCompletion);
+        }
     }
 
     In_Completion_Context = false;
@@ -1926,6 +4290,7 @@ MySQL_Editor::finalizeAutoComplete ( ) {
 void
 MySQL_Editor::setAutoCompleteKeywordsEnabled ( bool enable ) {
     AutoCompleteKeywordsEnabled = enable;
+    Completion_Model_Stale = true;
     initializeAutoComplete();
 }
 
@@ -1937,18 +4302,125 @@ MySQL_Editor::isAutoCompleteKeywordsEnabled ( ) const {
 void
 MySQL_Editor::setAutoCompleteIdentifierList ( QStringList identifier_list ) {
     Auto_Complete_Identifier_List = identifier_list;
+    Completion_Model_Stale = true;
+    initializeAutoComplete();
+}
+
+void
+MySQL_Editor::setAutoCompleteContextIdentifierList ( const QHash <QString, QStringList> &context_identifier_list ) {
+    Static_Schema_Provider->setContextIdentifiers(context_identifier_list);
+    setSchemaProvider(Static_Schema_Provider);
+}
+
+void
+MySQL_Editor::setSchemaProvider ( MySQL_Schema_Provider *schema_provider ) {
+    // The editor does not take ownership of schema_provider
+    if (Schema_Provider) QObject::disconnect(Schema_Provider, 0, this, 0);
+
+    Schema_Provider = schema_provider;
+    Context_Identifier_Cache.clear();
+    Pending_Context_Identifier.clear();
+    Pending_Context_Position = -1;
+
+    if (Schema_Provider) {
+        connect(Schema_Provider, SIGNAL(contextIdentifiersReady(QString, QStringList)),
+                this, SLOT(onContextIdentifiersReady(QString, QStringList)));
+    }
     initializeAutoComplete();
 }
 
 void
-MySQL_Editor::setAutoCompleteContextIdentifierList ( QHash <QString, QStringList> context_identifier_list ) {
-    Auto_Complete_Context_Identifier_List = context_identifier_list;
+MySQL_Editor::setSharedSchemaCatalog ( MySQL_Shared_Schema_Catalog *shared_schema_catalog ) {
+    // The editor does not take ownership of shared_schema_catalog
+    if (Shared_Schema_Catalog) QObject::disconnect(Shared_Schema_Catalog, 0, this, 0);
+
+    Shared_Schema_Catalog = shared_schema_catalog;
+
+    if (Shared_Schema_Catalog) {
+        connect(Shared_Schema_Catalog, SIGNAL(catalogChanged()), this, SLOT(onSchemaCatalogChanged()));
+    }
+    onSchemaCatalogChanged();
+}
+
+void
+MySQL_Editor::onSchemaCatalogChanged ( ) {
+    // Take the current snapshot, the previous one is released once unused
+    Schema_Catalog = Shared_Schema_Catalog ? Shared_Schema_Catalog->catalog() :
+                                             QSharedPointer <const MySQL_Schema_Catalog>();
+    Completion_Model_Stale = true;
+    if (In_Completion_Context and Completer and Completer->popup()->isVisible()) Completer->popup()->hide();
     initializeAutoComplete();
 }
 
+MySQL_Schema_Provider *
+MySQL_Editor::schemaProvider ( ) const {
+    return Schema_Provider;
+}
+
+void
+MySQL_Editor::setContextIdentifierCacheLimit ( int max_bytes ) {
+    Context_Identifier_Cache.setMaxCost(max_bytes);
+}
+
+void
+MySQL_Editor::onContextIdentifiersReady ( const QString &context_identifier,
+                                          const QStringList &identifiers ) {
+    // Unknown contexts are cached too, as empty lists
+    Context_Identifier_Cache.insert(context_identifier,
+                                    new QStringList(identifiers),
+                                    Context_Identifier_Cost(identifiers));
+
+    if (not (context_identifier == Pending_Context_Identifier)) return;
+
+    int pending_position = Pending_Context_Position;
+    Pending_Context_Identifier.clear();
+    Pending_Context_Position = -1;
+
+    // Still just past 'context_identifier.', possibly with a partial word typed
+    QTextCursor txt_cur = textCursor();
+    if (identifiers.isEmpty() or (not hasFocus()) or txt_cur.hasSelection() or
+        (txt_cur.position() < pending_position) or
+        (not (document()->characterAt(pending_position - 1) == '.'))) return;
+
+    txt_cur.setPosition(pending_position, QTextCursor::KeepAnchor);
+    QString completion_prefix = txt_cur.selectedText();
+    for (int ch_idx = 0; ch_idx < completion_prefix.length(); ch_idx += 1) {
+        QChar ch = completion_prefix.at(ch_idx);
+        if (not (ch.isLetterOrNumber() or (ch == '_') or (ch == '$'))) return;
+    }
+
+    showContextCompletion(identifiers, completion_prefix);
+}
+
+void
+MySQL_Editor::showContextCompletion ( const QStringList &identifiers,
+                                      const QString &completion_prefix ) {
+    cancelFuzzyCompletion();
+    // In a context, leave word-List in database order
+    Context_Completion_Model->setWords(identifiers, false);
+    Context_Completion_Model->setPrefix(completion_prefix);
+    Completer->setModelSorting(QCompleter::UnsortedModel);
+    Completer->setModel(Context_Completion_Model);
+    Completer->setCompletionMode(QCompleter::PopupCompletion);
+    // A 'completion context' is entered when a context indetifier is followed by '.', ...
+    // for example, 'table_name.' in which case all of the column names in table_name ...
+    // ... are displayed in the completer popup.
+    In_Completion_Context = true;
+
+    Completer->setCompletionPrefix(completion_prefix);
+    Completer->popup()->setCurrentIndex(Completer->completionModel()->index(0, 0));
+
+    MySQL_Trace_Scope trace_scope(&Editor_Trace, "completionPopup");
+    QRect cur_rect = cursorRect();
+    cur_rect.setWidth(Completer->popup()->sizeHintForColumn(0) +
+                      Completer->popup()->verticalScrollBar()->sizeHint().width());
+    Completer->complete(cur_rect); // popup it up!
+}
+
 void
 MySQL_Editor::setAutoCompleteIdentifiersEnabled ( bool enable ) {
     AutoCompleteIdentifiersEnabled = enable;
+    Completion_Model_Stale = true;
     initializeAutoComplete();
 }
 
@@ -1957,6 +4429,62 @@ MySQL_Editor::isAutoCompleteIdentifiersEnabled ( ) const {
     return AutoCompleteIdentifiersEnabled;
 }
 
+void
+MySQL_Editor::setFuzzyCompletionEnabled ( bool enable ) {
+    FuzzyCompletionEnabled = enable;
+    initializeAutoComplete();
+}
+
+bool
+MySQL_Editor::isFuzzyCompletionEnabled ( ) const {
+    return FuzzyCompletionEnabled;
+}
+
+void
+MySQL_Editor::requestFuzzyCompletion ( const QString &completion_prefix ) {
+    // Supersede (cancel) any query still being ranked
+    Fuzzy_Completion_Query_Generation = Fuzzy_Completion_Generation->fetchAndAddOrdered(1) + 1;
+    Fuzzy_Completion_Prefix = completion_prefix;
+    Fuzzy_Completion_Watcher->setFuture(QtConcurrent::run(Rank_Fuzzy_Completions,
+                                                          Completion_Model->words(),
+                                                          completion_prefix,
+                                                          Fuzzy_Completion_Generation,
+                                                          Fuzzy_Completion_Query_Generation));
+}
+
+void
+MySQL_Editor::cancelFuzzyCompletion ( ) {
+    Fuzzy_Completion_Generation->fetchAndAddOrdered(1);
+}
+
+void
+MySQL_Editor::onFuzzyCompletionReady ( ) {
+    // A newer keystroke, or leaving completion, made these results stale
+    if (not (Fuzzy_Completion_Generation->loadAcquire() == Fuzzy_Completion_Query_Generation)) return;
+
+    QStringList ranked_words = Fuzzy_Completion_Watcher->result();
+    if (ranked_words.isEmpty()) {
+        if (Completer->popup()->isVisible()) Completer->popup()->hide();
+        return;
+    }
+
+    // Rows are in rank order, QCompleter must not filter them by prefix
+    Fuzzy_Completion_Model->setWords(ranked_words, false);
+    if (not (Completer->model() == Fuzzy_Completion_Model)) {
+        Completer->setModel(Fuzzy_Completion_Model);
+        Completer->setModelSorting(QCompleter::UnsortedModel);
+        Completer->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+    }
+    Completer->setCompletionPrefix(Fuzzy_Completion_Prefix);
+    Completer->popup()->setCurrentIndex(Completer->completionModel()->index(0, 0));
+
+    MySQL_Trace_Scope trace_scope(&Editor_Trace, "completionPopup");
+    QRect cur_rect = cursorRect();
+    cur_rect.setWidth(Completer->popup()->sizeHintForColumn(0) +
+                      Completer->popup()->verticalScrollBar()->sizeHint().width());
+    Completer->complete(cur_rect); // popup it up!
+}
+
 void
 MySQL_Editor::setCompleter ( QCompleter *completer ) {
     if (Completer) QObject::disconnect(Completer, 0, this, 0);
@@ -28,6 +28,7 @@
 #include <QAbstractItemView>
 #include <QAbstractListModel>
 #include <QStringListModel>
+#include <QFutureWatcher>
 #include <QScrollBar>
 
 class MySQL_Editor;
@@ -38,6 +39,395 @@ class MySQL_Editor_DocLayout;
 #define Open_Fold_Bracket '('
 #define Close_Fold_Bracket ')'
 
+#if defined(Q_PROCESSOR_X86) && defined(Q_CC_GNU)
+#define MYSQL_EDITOR_SIMD_SCAN
+#endif
+
+// The lexer's UTF-16 scan kernels: index of the first of c0 .. c3 in ...
+// ... text[from, to), or to if none. One is picked at runtime from the ...
+// ... CPU's features, all are exposed for the differential test.
+typedef int (*Scan_Function) ( const ushort *text,
+                               int from,
+                               int to,
+                               ushort c0,
+                               ushort c1,
+                               ushort c2,
+                               ushort c3 );
+
+int
+Scan_For_Characters_Scalar ( const ushort *text,
+                             int from,
+                             int to,
+                             ushort c0,
+                             ushort c1,
+                             ushort c2,
+                             ushort c3 );
+
+#if defined(MYSQL_EDITOR_SIMD_SCAN)
+int
+Scan_For_Characters_SSE2 ( const ushort *text,
+                           int from,
+                           int to,
+                           ushort c0,
+                           ushort c1,
+                           ushort c2,
+                           ushort c3 );
+
+int
+Scan_For_Characters_AVX2 ( const ushort *text,
+                           int from,
+                           int to,
+                           ushort c0,
+                           ushort c1,
+                           ushort c2,
+                           ushort c3 );
+#endif
+
+// Allocation-free classification of keyword, function, type and interval ...
+// ... names. Open addressing over an ASCII case-folded hash, one probe ...
+// ... sequence answers all four classes at once, case-insensitively by ...
+// ... default (as the highlighter, which upper cased tokens) or exactly ...
+// ... (as the isKeyword-style API, which compared with QStringList::contains).
+class MySQL_Keyword_Table {
+public:
+    enum {
+        No_Class = 0,
+        Keyword_Class = 1,
+        Function_Class = 2,
+        Type_Class = 4,
+        Interval_Class = 8
+    };
+
+    MySQL_Keyword_Table ( );
+
+    void
+    insert ( const QStringList &words,
+             int word_class );
+
+    int
+    classify ( const QChar *word,
+               int length,
+               Qt::CaseSensitivity case_sensitivity = Qt::CaseInsensitive ) const;
+
+    int
+    classify ( const QString &word,
+               Qt::CaseSensitivity case_sensitivity = Qt::CaseInsensitive ) const;
+
+private:
+    struct Entry {
+        QByteArray word;
+        int word_class;
+    };
+
+    static uint
+    hashWord ( const QChar *word,
+               int length );
+
+    void
+    rehash ( int new_size );
+
+    QVector<Entry> Entries;
+    int Entry_Count;
+    int Max_Word_Length;
+};
+
+// One lexical token of a block, offset is relative to the block's start
+struct MySQL_Token {
+    enum Token_Class {
+        Operator,
+        Bracket,
+        Number,
+        String,
+        Comment,
+        Identifier,
+        Backticked_Identifier,
+        Keyword,
+        Function,
+        Type,
+        Interval
+    };
+
+    MySQL_Token ( ) : offset ( 0 ), length ( 0 ), token_class ( Operator ) { }
+
+    MySQL_Token ( int token_offset,
+                  int token_length,
+                  int token_type ) : offset ( token_offset ),
+                                     length ( token_length ),
+                                     token_class ( uchar(token_type) ) { }
+
+    // Keyword, function, type or interval, i.e. subject to uppercasing
+    bool
+    isKeywordClass ( ) const { return token_class >= Keyword; }
+
+    int offset;
+    int length;
+    uchar token_class;
+};
+
+Q_DECLARE_TYPEINFO(MySQL_Token, Q_PRIMITIVE_TYPE);
+
+// Persistent completer model. Sorted word lists answer a case-insensitive ...
+// ... prefix as a binary-searched row range, unsorted (context) lists are ...
+// ... filtered in their original order. Rows are only materialized by data().
+class MySQL_Completion_Model: public QAbstractListModel {
+public:
+    MySQL_Completion_Model ( QObject *parent = 0 );
+
+    void
+    setWords ( const QStringList &words,
+               bool sorted );
+
+    void
+    setPrefix ( const QString &prefix );
+
+    const QStringList &
+    words ( ) const { return Words; }
+
+    int
+    rowCount ( const QModelIndex &parent = QModelIndex() ) const Q_DECL_OVERRIDE;
+
+    QVariant
+    data ( const QModelIndex &index,
+           int role = Qt::DisplayRole ) const Q_DECL_OVERRIDE;
+
+private:
+    void
+    computeRows ( );
+
+    QStringList Words;
+    bool Words_Sorted;
+    QString Prefix;
+    // Rows are Words[First_Row, First_Row + Row_Count), or Filtered_Rows ...
+    // ... when an unsorted list is filtered by a prefix
+    int First_Row;
+    int Row_Count;
+    QVector<int> Filtered_Rows;
+};
+
+// Source of context completions, e.g. the column names of 'table_name.', ...
+// ... queried lazily by the editor. Answers arrive asynchronously through ...
+// ... contextIdentifiersReady, an empty list meaning an unknown context.
+class MySQL_Schema_Provider: public QObject {
+    Q_OBJECT
+
+public:
+    MySQL_Schema_Provider ( QObject *parent = 0 );
+
+    virtual void
+    requestContextIdentifiers ( const QString &context_identifier ) = 0;
+
+signals:
+    void
+    contextIdentifiersReady ( const QString &context_identifier,
+                              const QStringList &identifiers );
+};
+
+// Stand-in provider answering from an in-memory hash, from the event loop
+class MySQL_Static_Schema_Provider: public MySQL_Schema_Provider {
+    Q_OBJECT
+
+public:
+    MySQL_Static_Schema_Provider ( QObject *parent = 0 );
+
+    void
+    setContextIdentifiers ( const QHash <QString, QStringList> &context_identifiers );
+
+    void
+    requestContextIdentifiers ( const QString &context_identifier ) Q_DECL_OVERRIDE;
+
+private slots:
+    void
+    answerRequests ( );
+
+private:
+    QHash <QString, QStringList> Context_Identifiers;
+    QStringList Pending_Requests;
+};
+
+// Immutable schema snapshot: identifiers (sorted case-insensitively) and ...
+// ... context identifiers, every string interned so that names repeated ...
+// ... across tables share one buffer. Shared read-only by any number of ...
+// ... editors, never modified once built, replaced as a whole on refresh.
+class MySQL_Schema_Catalog {
+public:
+    MySQL_Schema_Catalog ( const QStringList &identifiers,
+                           const QHash <QString, QStringList> &context_identifiers );
+
+    const QStringList &
+    identifiers ( ) const { return Identifiers; }
+
+    bool
+    hasContext ( const QString &context_identifier ) const;
+
+    QStringList
+    contextIdentifiers ( const QString &context_identifier ) const;
+
+    // Identifiers merged with sorted_keywords, merged once and then shared
+    QStringList
+    completionWords ( const QStringList &sorted_keywords ) const;
+
+private:
+    QStringList Identifiers;
+    QHash <QString, QStringList> Context_Identifiers;
+
+    mutable QMutex Completion_Words_Mutex;
+    mutable QStringList Completion_Keywords;
+    mutable QStringList Completion_Words;
+};
+
+// Holder of the current catalog of one server, shared by its editors. ...
+// ... publish() swaps the snapshot (readers keep theirs alive while in use) ...
+// ... and tells the editors, no editor ever waits on a catalog being built.
+class MySQL_Shared_Schema_Catalog: public QObject {
+    Q_OBJECT
+
+public:
+    MySQL_Shared_Schema_Catalog ( QObject *parent = 0 );
+
+    QSharedPointer <const MySQL_Schema_Catalog>
+    catalog ( ) const;
+
+    // Thread safe, e.g. publish a catalog built on a worker thread
+    void
+    publish ( QSharedPointer <const MySQL_Schema_Catalog> catalog );
+
+signals:
+    void
+    catalogChanged ( );
+
+private:
+    mutable QMutex Catalog_Mutex;
+    QSharedPointer <const MySQL_Schema_Catalog> Catalog;
+};
+
+// Cumulative counts, and times in nanoseconds, of the editor's costly ...
+// ... operations since construction or the last reset. Cheap enough to ...
+// ... be always on: a counter increment and a monotonic clock read per call.
+struct MySQL_Editor_Counters {
+    MySQL_Editor_Counters ( ) : Highlighted_Blocks ( 0 ),
+                                Highlighted_Characters ( 0 ),
+                                Highlight_Nsecs ( 0 ),
+                                Contents_Changes ( 0 ),
+                                Contents_Change_Nsecs ( 0 ),
+                                Bracket_Matches ( 0 ),
+                                Bracket_Match_Nsecs ( 0 ),
+                                Uppercase_Passes ( 0 ),
+                                Uppercase_Nsecs ( 0 ),
+                                Sidebar_Updates ( 0 ),
+                                Sidebar_Nsecs ( 0 ),
+                                Completion_Model_Builds ( 0 ),
+                                Completion_Model_Nsecs ( 0 ) { }
+
+    // highlightBlock calls, and characters lexed by them
+    qint64 Highlighted_Blocks;
+    qint64 Highlighted_Characters;
+    qint64 Highlight_Nsecs;
+    qint64 Contents_Changes;
+    qint64 Contents_Change_Nsecs;
+    qint64 Bracket_Matches;
+    qint64 Bracket_Match_Nsecs;
+    qint64 Uppercase_Passes;
+    qint64 Uppercase_Nsecs;
+    qint64 Sidebar_Updates;
+    qint64 Sidebar_Nsecs;
+    qint64 Completion_Model_Builds;
+    qint64 Completion_Model_Nsecs;
+};
+
+// Optional scoped trace events of the editor's hot paths, in a fixed-size ...
+// ... ring buffer where the newest overwrite the oldest, dumpable as Chrome ...
+// ... trace JSON for chrome://tracing or Perfetto. Recording is lock-free, ...
+// ... a slot is claimed with an atomic increment; enable, disable and clear ...
+// ... from the GUI thread only.
+class MySQL_Editor_Trace {
+public:
+    MySQL_Editor_Trace ( );
+
+    // capacity is rounded up to a power of two
+    void
+    setEnabled ( bool enable,
+                 int capacity = 65536 );
+
+    bool
+    isEnabled ( ) const;
+
+    // Nanoseconds since the trace was created
+    qint64
+    now ( ) const;
+
+    // name must be a string literal, only its address is kept
+    void
+    record ( const char *name,
+             qint64 start_nsecs,
+             qint64 end_nsecs );
+
+    void
+    clear ( );
+
+    QByteArray
+    toChromeTraceJson ( ) const;
+
+private:
+    struct Event {
+        // Event number plus one once written, zero while being written
+        QAtomicInt Sequence;
+        const char *Name;
+        qint64 Start_Nsecs;
+        qint64 Duration_Nsecs;
+        quintptr Thread_Id;
+    };
+
+    QScopedArrayPointer<Event> Events;
+    uint Capacity;
+    QAtomicInt Next_Event;
+    QElapsedTimer Clock;
+    bool Enabled;
+
+    Q_DISABLE_COPY(MySQL_Editor_Trace)
+};
+
+// What findAll looks for, and replaceAll replaces it with. Matches never ...
+// ... span lines. A regular expression replacement may refer to its ...
+// ... captures as \0 .. \9, \\ is a backslash.
+struct MySQL_Find_Options {
+    MySQL_Find_Options ( ) : Regular_Expression ( false ),
+                             Case_Sensitivity ( Qt::CaseInsensitive ),
+                             Skip_Strings_And_Comments ( false ),
+                             Replace ( false ) { }
+
+    QString Pattern;
+    bool Regular_Expression;
+    Qt::CaseSensitivity Case_Sensitivity;
+    // Token-aware, matches starting in a string or comment are dropped
+    bool Skip_Strings_And_Comments;
+    bool Replace;
+    QString Replacement;
+};
+
+// One match, line is its block number
+struct MySQL_Find_Match {
+    int position;
+    int length;
+    int line;
+    QString replacement;
+};
+
+Q_DECLARE_TYPEINFO(MySQL_Find_Match, Q_MOVABLE_TYPE);
+
+// Matches sorted by position, positions are those of document revision ...
+// ... Revision. Too many replacements for an edit each are spliced into ...
+// ... Replace_Spans, runs of nearby matches replaced along with the text ...
+// ... between them. Empty when every match is an edit of its own.
+struct MySQL_Find_Result {
+    MySQL_Find_Result ( ) : Revision ( -1 ),
+                            Matching_Lines ( 0 ) { }
+
+    int Revision;
+    int Matching_Lines;
+    QVector<MySQL_Find_Match> Matches;
+    QVector<MySQL_Find_Match> Replace_Spans;
+};
+
 class MySQL_Editor: public QPlainTextEdit {
     Q_OBJECT
 
@@ -50,8 +440,12 @@ class MySQL_Editor: public QPlainTextEdit {
     Q_PROPERTY(bool AutoIndentEnabled READ isAutoIndentEnabled WRITE setAutoIndentEnabled)
     Q_PROPERTY(bool AutoCompleteKeywordsEnabled READ isAutoCompleteKeywordsEnabled WRITE setAutoCompleteKeywordsEnabled)
     Q_PROPERTY(bool AutoCompleteIdentifiersEnabled READ isAutoCompleteIdentifiersEnabled WRITE setAutoCompleteIdentifiersEnabled)
+    Q_PROPERTY(bool FuzzyCompletionEnabled READ isFuzzyCompletionEnabled WRITE setFuzzyCompletionEnabled)
     Q_PROPERTY(bool AutoUppercaseKeywordsEnabled READ isAutoUppercaseKeywordsEnabled WRITE setAutoUppercaseKeywordsEnabled)
 
+    // tests/bench times the private hot paths directly
+    friend class Bench_Editor;
+
 public:
     MySQL_Editor ( QWidget *parent = 0 );
     ~MySQL_Editor ( );
@@ -81,22 +475,30 @@ private:
     MySQL_Editor_Sidebar *Editor_Sidebar;
     MySQL_Editor_Highlighter *Editor_Highlighter;
     MySQL_Editor_DocLayout *Editor_Layout;
+    // Bracket tree generation the sidebar's fold markers were computed at
+    uint Sidebar_Bracket_Generation;
+    // A fold marker was left out, its match was in a deferred block
+    bool Sidebar_Fold_Unknown;
 
     QList<int> matchPositions;
     QList<int> errorPositions;
     QColor cursorColor;
     QColor bracketMatchColor;
     QColor bracketErrorColor;
+    QColor markerColor;
+
+    // Marked term, matched in the visible blocks only and shown as ...
+    // ... extra selections, the syntax formats are left alone
+    QString Mark_String;
+    QStringMatcher Mark_Matcher;
+    QList<QTextEdit::ExtraSelection> Mark_Selections;
+    bool Mark_Update_Queued;
 
     bool CodeFoldingEnabled;
     bool ShowLineNumbersEnabled;
 
     bool TextWrapEnabled;
 
-    QRegularExpression MySQL_Bracket_RegEx;
-    QString Bracket_Source_Text;
-    QString Bracket_Text;
-
     bool BracketsMatchingEnabled;
 
     bool Quote_Bracket_Character;
@@ -110,26 +512,71 @@ private:
 
     bool AutoUppercaseKeywordsEnabled;
 
-    QRegularExpression SQL_Token_Regular_Expression;
-
     QStringList MySQL_Keywords;
     QStringList MySQL_Functions;
     QStringList MySQL_Types;
     QStringList MySQL_Intervals;
     QStringList All_MySQL_Keywords;
+    QStringList Sorted_MySQL_Keywords;
+
+    MySQL_Keyword_Table Keyword_Table;
 
     QStringList Auto_Complete_Identifier_List;
-    QHash <QString, QStringList> Auto_Complete_Context_Identifier_List;
+    // Shared catalog, if any, takes precedence over the identifier list and ...
+    // ... the schema provider
+    QPointer <MySQL_Shared_Schema_Catalog> Shared_Schema_Catalog;
+    QSharedPointer <const MySQL_Schema_Catalog> Schema_Catalog;
+    // Context identifiers come from Schema_Provider (by default the static ...
+    // ... provider behind setAutoCompleteContextIdentifierList), cached LRU, ...
+    // ... cost in bytes
+    MySQL_Schema_Provider *Schema_Provider;
+    MySQL_Static_Schema_Provider *Static_Schema_Provider;
+    QCache <QString, QStringList> Context_Identifier_Cache;
+    // Context requested on '.', popped up on arrival if the cursor is still there
+    QString Pending_Context_Identifier;
+    int Pending_Context_Position;
     // A 'completion context' is entered when a context indetifier is followed by '.', ...
     // for example, 'table_name.' in which case all of the column names in table_name ...
     // ... are displayed in the completer popup.
     bool In_Completion_Context;
+    MySQL_Completion_Model *Completion_Model;
+    MySQL_Completion_Model *Context_Completion_Model;
+    // Keyword/identifier lists changed since Completion_Model was filled
+    bool Completion_Model_Stale;
+
+    // Fuzzy completion is ranked off the GUI thread. Bumping the shared ...
+    // ... generation cancels the query in flight, its results are dropped.
+    bool FuzzyCompletionEnabled;
+    MySQL_Completion_Model *Fuzzy_Completion_Model;
+    QFutureWatcher<QStringList> *Fuzzy_Completion_Watcher;
+    QSharedPointer<QAtomicInt> Fuzzy_Completion_Generation;
+    int Fuzzy_Completion_Query_Generation;
+    QString Fuzzy_Completion_Prefix;
+
+    // Find-all and replace-all, bumping the shared generation cancels the ...
+    // ... search in flight. Find_Revision is the revision searched.
+    MySQL_Find_Options Find_Options;
+    MySQL_Find_Result Find_Result;
+    QFutureWatcher<MySQL_Find_Result> *Find_Watcher;
+    QSharedPointer<QAtomicInt> Find_Generation;
+    int Find_Query_Generation;
+    int Find_Revision;
 
     QStringList Newline_Word_List;
     QStringList JOIN_Modifiers;
 
+    MySQL_Editor_Counters Performance_Counters;
+    MySQL_Editor_Trace Editor_Trace;
+
     bool Uppercasing_In_Process;
     int Previous_Cursor_Line;
+    // Text edited since the last auto uppercasing pass
+    bool Uppercase_Pending;
+    QTextCursor Uppercase_Dirty_Range;
+    // Streaming a huge paste into the document
+    bool Paste_In_Process;
+    // Replacing all matches or formatting, edits of our own
+    bool Bulk_Edit_In_Process;
 
 public:
     void
@@ -179,6 +626,83 @@ public:
     bool
     isInterval ( QString potential_interval );
 
+    int
+    classifyWord ( const QChar *word,
+                   int length ) const;
+
+    bool
+    isInsideStringOrComment ( int position );
+
+    void
+    setLargeDocumentHighlighting ( int block_threshold,
+                                   int slice_budget_msecs );
+
+    void
+    setLongLineThreshold ( int line_threshold );
+
+    // Snapshot of the performance counters, e.g. for a host's diagnostics
+    MySQL_Editor_Counters
+    performanceCounters ( ) const;
+
+    void
+    resetPerformanceCounters ( );
+
+    // Trace events, disabled until trace()->setEnabled(true)
+    MySQL_Editor_Trace *
+    trace ( );
+
+    // The statement around position, delimiter excluded, as a selection. ...
+    // ... DELIMITER commands are honoured, delimiters in strings and ...
+    // ... comments ignored.
+    QTextCursor
+    statementAt ( int position );
+
+    QList<QTextCursor>
+    statements ( );
+
+    // Searches a snapshot of the document on worker threads, the GUI ...
+    // ... thread only copies it. findFinished reports the match count, ...
+    // ... -1 for an empty or invalid pattern, or one spanning lines. ...
+    // ... A new search cancels the one in flight.
+    void
+    findAll ( const QString &pattern,
+              bool regular_expression = false,
+              Qt::CaseSensitivity sens = Qt::CaseInsensitive,
+              bool skip_strings_and_comments = false );
+
+    // Searches again with the last findAll's options, then replaces the ...
+    // ... matches in one edit block, one undo step
+    void
+    replaceAll ( const QString &replacement );
+
+    void
+    cancelFind ( );
+
+    bool
+    isFinding ( ) const;
+
+    const MySQL_Find_Result &
+    findResult ( ) const;
+
+signals:
+    void
+    findFinished ( int match_count );
+
+    void
+    replaceFinished ( int replace_count );
+
+private:
+    QTextCursor
+    statementCursor ( int start_position,
+                      int end_position );
+
+    void
+    startFind ( );
+
+private slots:
+    void
+    onFindFinished ( );
+
 public slots:
     void
     setBracketsMatchingEnabled ( bool enable );
@@ -260,38 +784,57 @@ protected:
     void
     insertFromMimeData ( const QMimeData* source ) Q_DECL_OVERRIDE;
 
+private:
+    void
+    insertPlainTextInChunks ( const QString &paste_text );
+
 private:
 #define MySQL_Bracket_List "()"
+#define MySQL_Bracket_Pair_Count ((sizeof(MySQL_Bracket_List) - 1) / 2)
 #define Default_Tab_Modulus 4
 
-    QString
-    Compute_Bracket_Text ( QString Source_Text );
-
     int
     Bracket_Match_Position ( int Current_Position );
 
     int
-    Compute_Current_Paren_Indent ( QString Current_Text,
-                                   int Current_Position );
+    Lexed_Bracket_Match_Position ( int Current_Position,
+                                   QTextBlock &needed_block );
+
+    int
+    Compute_Current_Paren_Indent ( int Current_Position );
 
     QTextCursor
     Select_Selected_Text_Lines ( );
 
 private slots:
     void
-    onTextChanged ( );
+    updateHighlightPriority ( );
+
+    void
+    onLongLineHighlighted ( );
+
+    void
+    onDeferredBlocksHighlighted ( );
+
+    void
+    onContentsChange ( int position,
+                       int chars_removed,
+                       int chars_added );
 
     void
     onCursorPositionChanged ( );
 
 private:
     int
-    findClosingConstruct ( const QTextBlock &block );
+    findFoldEndBlock ( const QTextBlock &block );
 
 private slots:
     void
     updateCursor ( );
 
+    void
+    updateMarkSelections ( );
+
 public slots:
     void
     updateSidebar ( );
@@ -328,7 +871,19 @@ public:
     setAutoCompleteIdentifierList ( QStringList identifier_list );
 
     void
-    setAutoCompleteContextIdentifierList ( QHash <QString, QStringList> context_identifier_list );
+    setAutoCompleteContextIdentifierList ( const QHash <QString, QStringList> &context_identifier_list );
+
+    void
+    setSchemaProvider ( MySQL_Schema_Provider *schema_provider );
+
+    MySQL_Schema_Provider *
+    schemaProvider ( ) const;
+
+    void
+    setContextIdentifierCacheLimit ( int max_bytes );
+
+    void
+    setSharedSchemaCatalog ( MySQL_Shared_Schema_Catalog *shared_schema_catalog );
 
     void
     setAutoCompleteIdentifiersEnabled ( bool enable ) ;
@@ -336,6 +891,34 @@ public:
     bool
     isAutoCompleteIdentifiersEnabled ( ) const;
 
+    void
+    setFuzzyCompletionEnabled ( bool enable );
+
+    bool
+    isFuzzyCompletionEnabled ( ) const;
+
+private:
+    void
+    requestFuzzyCompletion ( const QString &completion_prefix );
+
+    void
+    cancelFuzzyCompletion ( );
+
+    void
+    showContextCompletion ( const QStringList &identifiers,
+                            const QString &completion_prefix );
+
+private slots:
+    void
+    onFuzzyCompletionReady ( );
+
+    void
+    onContextIdentifiersReady ( const QString &context_identifier,
+                                const QStringList &identifiers );
+
+    void
+    onSchemaCatalogChanged ( );
+
 private:
     void
     setCompleter ( QCompleter *completer );
@@ -359,37 +942,393 @@ private:
 
 };
 
+class MySQL_Bracket_Tree;
+
+// Bracket sequence summary for one open/close pair of MySQL_Bracket_List, ...
+// ... net depth change and lowest running depth (never above zero).
+struct MySQL_Bracket_Summary {
+    int net;
+    int min_prefix;
+};
+
+// Long lines only, a point between tokens where lexing can resume
+struct MySQL_Lex_Checkpoint {
+    int offset;
+    int state;
+};
+
+Q_DECLARE_TYPEINFO(MySQL_Lex_Checkpoint, Q_PRIMITIVE_TYPE);
+
+// A statement ends at offset, before its delimiter, the next one ...
+// ... starts at resume, after it
+struct MySQL_Statement_End {
+    int offset;
+    int resume;
+};
+
+Q_DECLARE_TYPEINFO(MySQL_Statement_End, Q_PRIMITIVE_TYPE);
+
 class MySQLBlockData: public QTextBlockUserData {
 public:
+    MySQLBlockData ( );
+    ~MySQLBlockData ( );
+
     QList<int> bracketPositions;
+    QString bracketCharacters;
+
+    // Token cache, shared by highlighting, uppercasing and formatting
+    QVector<MySQL_Token> Tokens;
+
+    // Long line mode, Tokens and the bracket index cover offsets ...
+    // ... Window_First to Window_Last only, Block_Summary the whole line
+    bool Long_Line;
+    int Window_First;
+    int Window_Last;
+    QVector<MySQL_Lex_Checkpoint> Checkpoints;
+
+    // Statement delimiters outside strings and comments, in offset order
+    QVector<MySQL_Statement_End> Statement_Ends;
+
+    // Node of the bracket depth tree, one per block in document order
+    MySQL_Bracket_Tree *Tree;
+    MySQLBlockData *Tree_Parent;
+    MySQLBlockData *Tree_Left;
+    MySQLBlockData *Tree_Right;
+    uint Tree_Priority;
+    int Tree_Size;
+    MySQL_Bracket_Summary Block_Summary[MySQL_Bracket_Pair_Count];
+    MySQL_Bracket_Summary Subtree_Summary[MySQL_Bracket_Pair_Count];
+    int Subtree_Statements;
+
+    // Fold region, block number closing this block's fold and the ...
+    // ... bracket tree generation it was computed at
+    int Fold_End_Block;
+    uint Fold_Generation;
+};
+
+// Balanced-parenthesis depth tree over the document's blocks. A treap ordered ...
+// ... by block position, each node aggregating the bracket summaries of its subtree, ...
+// ... so finding the block that holds a matching bracket takes O(log n). Statement ...
+// ... ends are counted likewise, for the statement index.
+class MySQL_Bracket_Tree {
+public:
+    MySQL_Bracket_Tree ( );
+    ~MySQL_Bracket_Tree ( );
+
+    void
+    insertAfter ( MySQLBlockData *node,
+                  MySQLBlockData *previous );
+
+    void
+    remove ( MySQLBlockData *node );
+
+    void
+    update ( MySQLBlockData *node,
+             bool summarize_block = true );
+
+    int
+    blockNumber ( const MySQLBlockData *node ) const;
+
+    // Statement ends in the blocks before node
+    int
+    statementsBefore ( const MySQLBlockData *node ) const;
+
+    int
+    statementCount ( ) const;
+
+    // Block holding the statement_idx-th statement end of the document, ...
+    // ... block_statement_idx its index within the block
+    MySQLBlockData *
+    findStatement ( int statement_idx,
+                    int &block_statement_idx ) const;
+
+    MySQLBlockData *
+    findForward ( const MySQLBlockData *node,
+                  int pair,
+                  int &paren_level ) const;
+
+    MySQLBlockData *
+    findBackward ( const MySQLBlockData *node,
+                   int pair,
+                   int &paren_level ) const;
+
+    static int
+    scanBlock ( const MySQLBlockData *node,
+                int pair,
+                int bracket_idx,
+                bool search_forward,
+                int &paren_level );
+
+    static void
+    addBracket ( MySQL_Bracket_Summary *summaries,
+                 QChar bracket );
+
+    // Bumped whenever a block is inserted or removed or its bracket ...
+    // ... summary changes, edits and deferred highlighting alike
+    uint
+    generation ( ) const;
+
+private:
+    void
+    pull ( MySQLBlockData *node );
+
+    void
+    rotateUp ( MySQLBlockData *node );
+
+    MySQLBlockData *Root;
+    uint Random_State;
+    uint Generation;
 };
 
+// One block lexed off the GUI thread, valid if entered in entry_state
+struct MySQL_Lexed_Block {
+    QVector<MySQL_Token> tokens;
+    int length;
+    int entry_state;
+    int exit_state;
+};
+
+Q_DECLARE_TYPEINFO(MySQL_Lexed_Block, Q_MOVABLE_TYPE);
+
 class MySQL_Editor_Highlighter : public QSyntaxHighlighter {
+    Q_OBJECT
+
 public:
     MySQL_Editor_Highlighter ( QTextDocument *parent = 0 );
 
+    // Parsing state, the block state holds one of these
+    enum Lexical_State {
+        Start = 0,
+        Number = 1,
+        Identifier = 2,
+        Backticked_Identifier = 3,
+        String = 4,
+        Comment = 5,
+        To_EOL_Comment = 6,
+        // Large documents only, block not lexed yet
+        Pending = 8
+    };
+
+    enum {
+        Lexical_State_Mask = 0xFF,
+        // Large documents only, block lexed from a guessed entry state
+        Speculative_Flag = 0x100,
+        // Bits above hold the statement delimiter in effect at the block's end
+        Delimiter_Shift = 9
+    };
+
+    // Entry state for lexing the block following one in block_state
+    static int
+    lexicalState ( int block_state );
+
+    // Pending or speculative, i.e. still to be lexed for real
+    static bool
+    isDeferredState ( int block_state );
+
+    // Statement delimiter in effect after a block in block_state, ...
+    // ... ";" unless changed by a DELIMITER command
+    QString
+    delimiter ( int block_state ) const;
+
     void
     setColor( MySQL_Editor::ColorComponent component,
               const QColor &color );
 
-    void
-    mark( const QString &str,
-          Qt::CaseSensitivity caseSensitivity );
-
 public:
     void
     setHighlightMySQLEditor ( MySQL_Editor *highlight_mysql_editor );
 
+    MySQL_Bracket_Tree *
+    bracketTree ( );
+
+    static int
+    lexText ( const QString &text,
+              int state,
+              const MySQL_Editor *editor,
+              QVector<MySQL_Token> &tokens );
+
+    // Lexes from offset from, stopping between tokens at or after ...
+    // ... stop_after. *stop_position is where it stopped, -1 at end of text.
+    static int
+    lexTextRange ( const QString &text,
+                   int state,
+                   const MySQL_Editor *editor,
+                   QVector<MySQL_Token> &tokens,
+                   int from,
+                   int stop_after,
+                   int *stop_position );
+
+    // Blocks of more than line_threshold characters (none if < 0) keep ...
+    // ... tokens and formats for the columns around the visible ones only
+    void
+    setLongLineThreshold ( int line_threshold );
+
+    void
+    setHorizontalWindow ( int first_column,
+                          int last_column );
+
+    // Tokens of block covering first_offset to last_offset (end of block ...
+    // ... if < 0), lexed again for long lines outside their window
+    QVector<MySQL_Token>
+    blockTokens ( const QTextBlock &block,
+                  int first_offset = 0,
+                  int last_offset = -1 ) const;
+
+    // Highlighting counters only, the editor keeps the others
+    const MySQL_Editor_Counters &
+    counters ( ) const;
+
+    void
+    resetCounters ( );
+
+    // Documents of more than block_threshold blocks (none if < 0) are ...
+    // ... highlighted viewport first, the rest in idle-time slices of ...
+    // ... slice_budget_msecs each
+    void
+    setDeferredHighlighting ( int block_threshold,
+                              int slice_budget_msecs );
+
+    void
+    setPriorityWindow ( int first_block_number,
+                        int last_block_number );
+
+    // Any deferred block, or any up to and including last_block
+    bool
+    hasPendingHighlighting ( const QTextBlock &last_block = QTextBlock() ) const;
+
+    // Lex the deferred blocks now, every one for whole-document operations ...
+    // ... or up to and including last_block before reading its tokens or state
+    void
+    finishPendingHighlighting ( const QTextBlock &last_block = QTextBlock() );
+
+    // Stop and wait for the worker threads, before the editor goes away
+    void
+    cancelParallelLexing ( );
+
+signals:
+    void
+    longLineHighlighted ( );
+
+    // After an idle-time slice or priority window, which may have ...
+    // ... indexed brackets without the document changing
+    void
+    deferredBlocksHighlighted ( );
+
 protected:
     void
     highlightBlock ( const QString &text );
 
+private slots:
+    void
+    highlightPriorityWindow ( );
+
+    void
+    highlightLongLineWindows ( );
+
+    void
+    highlightPendingSlice ( );
+
+    void
+    endHighlightBatch ( );
+
+    void
+    onParallelLexingFinished ( );
+
 private:
+    bool
+    isDeferring ( ) const;
+
+    bool
+    isBudgetLeft ( );
+
+    void
+    notePendingBlock ( );
+
+    QTextBlock
+    nextDeferredBlock ( QTextBlock block ) const;
+
+    void
+    startParallelLexing ( const QTextBlock &first_block );
+
+    int
+    lexBlock ( const QString &text,
+               int state,
+               QVector<MySQL_Token> &tokens,
+               MySQLBlockData *block_data );
+
+    int
+    lexLongLine ( const QString &text,
+                  int state,
+                  QVector<MySQL_Token> &tokens,
+                  MySQLBlockData *block_data );
+
+    void
+    lexLongLineWindow ( const QTextBlock &block,
+                        const MySQLBlockData *block_data,
+                        int first_offset,
+                        int last_offset,
+                        QVector<MySQL_Token> &tokens,
+                        QString &fragment,
+                        int &fragment_offset ) const;
+
+    void
+    formatLongLineWindow ( const QTextBlock &block );
+
+    void
+    windowOffsets ( int text_length,
+                    int &first_offset,
+                    int &last_offset ) const;
+
+    QColor
+    tokenColor ( int token_class ) const;
+
+    int
+    delimiterCommand ( const QString &text,
+                       int state,
+                       MySQLBlockData *block_data );
+
+    static void
+    findStatementEnds ( const QString &text,
+                        int from,
+                        int to,
+                        const QVector<MySQL_Token> &tokens,
+                        const QString &delimiter,
+                        MySQLBlockData *block_data );
+
     MySQL_Editor *Highlight_MySQL_Editor;
 
+    int Deferred_Block_Threshold;
+    int Slice_Budget_Msecs;
+    int Priority_First_Block;
+    int Priority_Last_Block;
+    bool Priority_Update_Queued;
+    // Time spent highlighting since control last returned to the event loop
+    QElapsedTimer Batch_Timer;
+    bool Budget_Unlimited;
+    // At or before the first deferred block
+    QTextCursor Pending_Cursor;
+    QTimer *Pending_Timer;
+    // Deferred blocks from Parallel_First_Block on, lexed by worker threads ...
+    // ... for document revision Parallel_Lex_Revision
+    QFutureWatcher<QVector<MySQL_Lexed_Block> > *Parallel_Lex_Watcher;
+    QSharedPointer<QAtomicInt> Parallel_Lex_Generation;
+    int Parallel_Lex_Revision;
+    int Parallel_First_Block;
+    QVector<MySQL_Lexed_Block> Parallel_Blocks;
+
+    int Long_Line_Threshold;
+    int Visible_First_Column;
+    int Visible_Last_Column;
+    bool Long_Line_Update_Queued;
+
+    // Delimiters seen in DELIMITER commands, block states hold their index
+    QStringList Delimiters;
+
+    MySQL_Editor_Counters Counters;
+
+    MySQL_Bracket_Tree Bracket_Tree;
+
     QHash<MySQL_Editor::ColorComponent, QColor> m_colors;
-    QString m_markString;
-    Qt::CaseSensitivity m_markCaseSensitivity;
 };
 
 struct BlockInfo {
@@ -0,0 +1,8 @@
+# Benchmarks, built with the tests but left out of make check, e.g.
+#   ./tst_bench -json bench.json
+#   BENCH_MAX_LINES=10000 ./tst_bench -json quick.json
+TARGET = tst_bench
+include(../editor.pri)
+CONFIG -= testcase
+HEADERS += bench_corpus.h
+SOURCES += bench_corpus.cpp tst_bench.cpp
@@ -0,0 +1,203 @@
+#include "bench_corpus.h"
+
+#define Bench_Corpus_Column_Count 32
+
+Bench_Corpus::Bench_Corpus ( quint32 seed ) : Random_State ( seed ),
+                                              Table_Count ( 0 ),
+                                              Procedure_Count ( 0 ) {
+}
+
+QString
+Bench_Corpus::generate ( Kind kind,
+                         int line_count,
+                         QStringList *identifiers,
+                         quint32 seed ) {
+    Bench_Corpus corpus(seed);
+    QStringList lines;
+    lines.reserve(line_count + 64);
+    while (lines.count() < line_count) {
+        switch (kind) {
+            case Dump:
+                corpus.appendDumpTable(lines);
+                break;
+            case Stored_Procedures:
+                corpus.appendStoredProcedure(lines);
+                break;
+            case In_Lists:
+                corpus.appendInListQuery(lines, line_count - lines.count());
+                break;
+        }
+    }
+    // The last statement may be cut short, as in a partly loaded file
+    while (lines.count() > line_count) lines.removeLast();
+
+    if (identifiers) {
+        for (int table_idx = 0; table_idx < corpus.Table_Count; table_idx += 1)
+            *identifiers << QString("t_%1").arg(table_idx);
+        for (int column_idx = 0; column_idx < Bench_Corpus_Column_Count; column_idx += 1)
+            *identifiers << QString("c_%1").arg(column_idx);
+        for (int procedure_idx = 0; procedure_idx < corpus.Procedure_Count; procedure_idx += 1)
+            *identifiers << QString("p_%1").arg(procedure_idx);
+    }
+    return lines.join(QChar('\n'));
+}
+
+QString
+Bench_Corpus::kindName ( Kind kind ) {
+    switch (kind) {
+        case Dump:
+            return "dump";
+        case Stored_Procedures:
+            return "procedures";
+        case In_Lists:
+            return "in_lists";
+    }
+    return QString();
+}
+
+quint32
+Bench_Corpus::next ( quint32 bound ) {
+    // Same LCG as the scan test, reproducible on every platform
+    Random_State = (Random_State * 1664525u) + 1013904223u;
+    return (Random_State >> 8) % bound;
+}
+
+QString
+Bench_Corpus::tableName ( ) {
+    // An existing table mostly, now and then a new one
+    int table_idx = int(next(quint32(Table_Count + 1)));
+    if (table_idx == Table_Count) Table_Count += 1;
+    return QString("t_%1").arg(table_idx);
+}
+
+QString
+Bench_Corpus::columnName ( ) {
+    return QString("c_%1").arg(next(Bench_Corpus_Column_Count));
+}
+
+void
+Bench_Corpus::appendDumpTable ( QStringList &lines ) {
+    // As written by mysqldump: uppercase keywords, backticked names and ...
+    // ... extended INSERTs, many rows to a line
+    QString table = QString("t_%1").arg(Table_Count);
+    Table_Count += 1;
+    int column_count = 3 + int(next(6));
+
+    lines << "--"
+          << QString("-- Table structure for table `%1`").arg(table)
+          << "--"
+          << ""
+          << QString("DROP TABLE IF EXISTS `%1`;").arg(table)
+          << QString("CREATE TABLE `%1` (").arg(table)
+          << "  `id` int(11) NOT NULL AUTO_INCREMENT,";
+    for (int column_idx = 1; column_idx <= column_count; column_idx += 1) {
+        switch (column_idx % 4) {
+            case 0:
+                lines << QString("  `c_%1` int(11) DEFAULT NULL,").arg(column_idx);
+                break;
+            case 1:
+                lines << QString("  `c_%1` varchar(64) DEFAULT NULL,").arg(column_idx);
+                break;
+            case 2:
+                lines << QString("  `c_%1` decimal(10,2) NOT NULL DEFAULT '0.00',").arg(column_idx);
+                break;
+            default:
+                lines << QString("  `c_%1` datetime DEFAULT NULL,").arg(column_idx);
+                break;
+        }
+    }
+    lines << "  PRIMARY KEY (`id`)"
+          << ") ENGINE=InnoDB DEFAULT CHARSET=utf8;"
+          << ""
+          << QString("LOCK TABLES `%1` WRITE;").arg(table);
+
+    int insert_count = 4 + int(next(28));
+    int row_id = 1;
+    for (int insert_idx = 0; insert_idx < insert_count; insert_idx += 1) {
+        QString insert = QString("INSERT INTO `%1` VALUES ").arg(table);
+        for (int row_idx = 0; row_idx < 8; row_idx += 1) {
+            if (row_idx > 0) insert += ',';
+            insert += '(' + QString::number(row_id);
+            row_id += 1;
+            for (int column_idx = 1; column_idx <= column_count; column_idx += 1) {
+                insert += ',';
+                switch (column_idx % 4) {
+                    case 0:
+                        insert += ((next(4) == 0) ? QString("NULL") : QString::number(next(100000)));
+                        break;
+                    case 1:
+                        insert += QString("'name %1%2'").arg(next(10000)).arg((next(8) == 0) ? "\\'s (copy)" : "");
+                        break;
+                    case 2:
+                        insert += QString("'%1.%2'").arg(next(100000)).arg(next(100), 2, 10, QChar('0'));
+                        break;
+                    default:
+                        insert += QString("'2016-%1-%2 12:00:00'").arg(1 + next(12), 2, 10, QChar('0'))
+                                                                   .arg(1 + next(28), 2, 10, QChar('0'));
+                        break;
+                }
+            }
+            insert += ')';
+        }
+        insert += ';';
+        lines << insert;
+    }
+    lines << "UNLOCK TABLES;"
+          << "";
+}
+
+void
+Bench_Corpus::appendStoredProcedure ( QStringList &lines ) {
+    // Lowercase keywords, left for auto uppercasing, a custom delimiter, ...
+    // ... comments of both kinds and nested brackets
+    QString procedure = QString("p_%1").arg(Procedure_Count);
+    Procedure_Count += 1;
+    QString table = tableName();
+
+    lines << "DELIMITER $$"
+          << QString("create procedure %1 ( in p_id int, out p_total decimal(10,2) )").arg(procedure)
+          << "begin"
+          << "  declare v_count int default 0;"
+          << "  declare v_name varchar(64) default 'it''s';"
+          << "  /* totals of the rows after p_id,"
+          << "     skipping the archived ones */";
+    int statement_count = 1 + int(next(4));
+    for (int statement_idx = 0; statement_idx < statement_count; statement_idx += 1) {
+        QString column = columnName();
+        QString other_column = columnName();
+        lines << QString("  select count(*), sum(%1) into v_count, p_total").arg(column)
+              << QString("  from %1 where id > p_id and (%2 like 'a%' or %3 in (1, 2, 3));")
+                 .arg(table, other_column, columnName())
+              << "  if v_count > 10 then"
+              << QString("    update %1 set %2 = %2 * 1.1 where id = p_id; -- raise").arg(table, column)
+              << "  else"
+              << QString("    insert into %1 (%2, %3) values (\"x\", concat('a', \"b\", `%3`));")
+                 .arg(tableName(), column, other_column)
+              << "  end if;";
+    }
+    lines << "end$$"
+          << "DELIMITER ;"
+          << "";
+}
+
+void
+Bench_Corpus::appendInListQuery ( QStringList &lines,
+                                  int max_lines ) {
+    // Generated queries with thousands of values, 16 to a line
+    int value_line_count = qMax(1, qMin(max_lines - 6, 16 + int(next(2000))));
+    lines << QString("select %1, %2").arg(columnName(), columnName())
+          << QString("from %1").arg(tableName())
+          << "where id in (";
+    int value = int(next(1000));
+    for (int line_idx = 0; line_idx < value_line_count; line_idx += 1) {
+        QStringList values;
+        for (int value_idx = 0; value_idx < 16; value_idx += 1) {
+            values << QString::number(value);
+            value += 1 + int(next(9));
+        }
+        lines << ("  " + values.join(", ") + (((line_idx + 1) < value_line_count) ? "," : ""));
+    }
+    lines << QString(") and %1 in ('a', 'b', \"c\", 'it''s')").arg(columnName())
+          << "order by id;"
+          << "";
+}
@@ -0,0 +1,61 @@
+// Seeded synthetic SQL for the benchmarks: mysqldump style dumps, stored ...
+// ... procedures between DELIMITER commands and queries with huge IN lists. ...
+// ... The same kind, line count and seed always give the same text.
+
+#ifndef BENCH_CORPUS_H
+#define BENCH_CORPUS_H
+
+#include <QString>
+#include <QStringList>
+
+#define Bench_Corpus_Default_Seed 20261016u
+
+class Bench_Corpus {
+public:
+    typedef enum {
+        Dump,
+        Stored_Procedures,
+        In_Lists
+    } Kind;
+
+    static const int Kind_Count = 3;
+
+    // Text of line_count lines, the table, column and procedure names ...
+    // ... it uses are appended to identifiers when given
+    static QString
+    generate ( Kind kind,
+               int line_count,
+               QStringList *identifiers = 0,
+               quint32 seed = Bench_Corpus_Default_Seed );
+
+    static QString
+    kindName ( Kind kind );
+
+private:
+    Bench_Corpus ( quint32 seed );
+
+    quint32
+    next ( quint32 bound );
+
+    QString
+    tableName ( );
+
+    QString
+    columnName ( );
+
+    void
+    appendDumpTable ( QStringList &lines );
+
+    void
+    appendStoredProcedure ( QStringList &lines );
+
+    void
+    appendInListQuery ( QStringList &lines,
+                        int max_lines );
+
+    quint32 Random_State;
+    int Table_Count;
+    int Procedure_Count;
+};
+
+#endif // BENCH_CORPUS_H
@@ -0,0 +1,517 @@
+// Benchmarks of the editor's hot paths on seeded synthetic corpora of 1k ...
+// ... to 1M lines, on the offscreen platform unless told otherwise. Besides ...
+// ... QtTest's own output the results are written as JSON, to the file ...
+// ... given by -json (bench.json by default). BENCH_MAX_LINES caps the ...
+// ... corpus sizes for quick runs. Editor construction is timed too, with ...
+// ... the resident memory each further instance adds.
+
+#include "MySQL_Editor.h"
+#include "bench_corpus.h"
+
+#include <QApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtTest>
+
+#if defined(Q_OS_LINUX)
+#include <unistd.h>
+#endif
+
+#define Bench_Max_Lines 1000000
+#define Bench_Sample_Count 1000
+#define Bench_Editor_Instances 50
+
+// Time of the iterations QBENCHMARK chose to run, setup left out
+struct Bench_Timing {
+    Bench_Timing ( ) : Nsecs ( 0 ),
+                       Iterations ( 0 ) { }
+
+    void
+    start ( ) {
+        Timer.start();
+    }
+
+    void
+    stop ( ) {
+        Nsecs += Timer.nsecsElapsed();
+        Iterations += 1;
+    }
+
+    QElapsedTimer Timer;
+    qint64 Nsecs;
+    int Iterations;
+};
+
+static qint64
+Resident_Bytes ( ) {
+    // Resident set size, -1 where unknown
+#if defined(Q_OS_LINUX)
+    QFile statm("/proc/self/statm");
+    if (not statm.open(QIODevice::ReadOnly)) return -1;
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.count() < 2) return -1;
+    return fields.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return -1;
+#endif
+}
+
+class Bench_Editor : public QObject {
+    Q_OBJECT
+
+public:
+    Bench_Editor ( const QString &json_file_name );
+
+private slots:
+    void
+    initTestCase ( );
+
+    void
+    cleanupTestCase ( );
+
+    void
+    constructEditor ( );
+
+    void
+    highlightBlock_data ( );
+
+    void
+    highlightBlock ( );
+
+    void
+    bracketMatchPosition_data ( );
+
+    void
+    bracketMatchPosition ( );
+
+    void
+    computeCurrentParenIndent_data ( );
+
+    void
+    computeCurrentParenIndent ( );
+
+    void
+    uppercaseSqlKeywords_data ( );
+
+    void
+    uppercaseSqlKeywords ( );
+
+    void
+    uppercaseSqlKeywordsDocument_data ( );
+
+    void
+    uppercaseSqlKeywordsDocument ( );
+
+    void
+    simpleFormatSql_data ( );
+
+    void
+    simpleFormatSql ( );
+
+    void
+    updateSidebar_data ( );
+
+    void
+    updateSidebar ( );
+
+    void
+    initializeAutoComplete_data ( );
+
+    void
+    initializeAutoComplete ( );
+
+private:
+    void
+    corpusData ( );
+
+    void
+    loadCorpus ( );
+
+    QList<int>
+    samplePositions ( const QString &characters );
+
+    void
+    invalidateVisibleFolds ( );
+
+    void
+    record ( const QString &benchmark,
+             const Bench_Timing &timing,
+             int calls_per_iteration,
+             bool whole_document = false );
+
+    MySQL_Editor *Editor;
+    QString Json_File_Name;
+    QJsonArray Results;
+
+    // Corpus in the editor, Loaded_Name is cleared once a benchmark edits it
+    QString Loaded_Name;
+    Bench_Corpus::Kind Loaded_Kind;
+    int Loaded_Lines;
+    int Loaded_Characters;
+    QStringList Loaded_Identifiers;
+};
+
+Bench_Editor::Bench_Editor ( const QString &json_file_name ) : Editor ( 0 ),
+                                                               Json_File_Name ( json_file_name ),
+                                                               Loaded_Kind ( Bench_Corpus::Dump ),
+                                                               Loaded_Lines ( 0 ),
+                                                               Loaded_Characters ( 0 ) {
+}
+
+void
+Bench_Editor::initTestCase ( ) {
+    // The first editor builds the tables shared by all instances
+    Bench_Timing first_timing;
+    first_timing.start();
+    Editor = new MySQL_Editor();
+    first_timing.stop();
+    record("MySQL_Editor.first", first_timing, 1);
+    // Everything lexed as the text is set, no idle-time slices in between
+    Editor->setLargeDocumentHighlighting(-1, 0);
+    // Edits only where benchmarked, undo history would grow with every one
+    Editor->setAutoUppercaseKeywordsEnabled(false);
+    Editor->document()->setUndoRedoEnabled(false);
+    Editor->setShowLineNumbersEnabled(true);
+    Editor->setCodeFoldingEnabled(true);
+    Editor->resize(1000, 800);
+    Editor->show();
+    QVERIFY(QTest::qWaitForWindowExposed(Editor));
+}
+
+void
+Bench_Editor::cleanupTestCase ( ) {
+    delete Editor;
+    Editor = 0;
+
+    QJsonObject root;
+    root["qt_version"] = QString(qVersion());
+    root["platform"] = QGuiApplication::platformName();
+    root["seed"] = double(Bench_Corpus_Default_Seed);
+    root["results"] = Results;
+    QFile json_file(Json_File_Name);
+    QVERIFY2(json_file.open(QIODevice::WriteOnly | QIODevice::Truncate), qPrintable(json_file.errorString()));
+    json_file.write(QJsonDocument(root).toJson());
+}
+
+void
+Bench_Editor::corpusData ( ) {
+    QTest::addColumn<int>("kind");
+    QTest::addColumn<int>("lines");
+
+    bool max_lines_set = false;
+    int max_lines = qEnvironmentVariableIntValue("BENCH_MAX_LINES", &max_lines_set);
+    if (not max_lines_set) max_lines = Bench_Max_Lines;
+
+    for (int lines = 1000; lines <= max_lines; lines *= 10) {
+        for (int kind = 0; kind < Bench_Corpus::Kind_Count; kind += 1) {
+            QString name = QString("%1 %2").arg(Bench_Corpus::kindName(Bench_Corpus::Kind(kind))).arg(lines);
+            QTest::newRow(qPrintable(name)) << kind << lines;
+        }
+    }
+}
+
+void
+Bench_Editor::loadCorpus ( ) {
+    QFETCH(int, kind);
+    QFETCH(int, lines);
+
+    QString name = QString("%1 %2").arg(Bench_Corpus::kindName(Bench_Corpus::Kind(kind))).arg(lines);
+    if (Loaded_Name == name) return;
+
+    Loaded_Name.clear();
+    Loaded_Identifiers.clear();
+    QString text = Bench_Corpus::generate(Bench_Corpus::Kind(kind), lines, &Loaded_Identifiers);
+    Editor->setPlainText(text);
+    Editor->moveCursor(QTextCursor::Start);
+    QCoreApplication::processEvents();
+
+    Loaded_Kind = Bench_Corpus::Kind(kind);
+    Loaded_Lines = lines;
+    Loaded_Characters = text.length();
+    Loaded_Name = name;
+}
+
+QList<int>
+Bench_Editor::samplePositions ( const QString &characters ) {
+    // Up to Bench_Sample_Count positions of characters, spread evenly ...
+    // ... over the document, or of any character if characters is empty
+    QString text = Editor->toPlainText();
+    QList<int> samples;
+    if (characters.isEmpty()) {
+        int step = qMax(1, text.length() / Bench_Sample_Count);
+        for (int position = 0; position < text.length(); position += step) samples << position;
+        return samples;
+    }
+
+    QList<int> positions;
+    for (int position = 0; position < text.length(); position += 1)
+        if (characters.contains(text.at(position))) positions << position;
+    int step = qMax(1, positions.count() / Bench_Sample_Count);
+    for (int position_idx = 0; position_idx < positions.count(); position_idx += step)
+        samples << positions.at(position_idx);
+    return samples;
+}
+
+void
+Bench_Editor::invalidateVisibleFolds ( ) {
+    // Cold fold cache, as after an edit changed the bracket tree
+    uint bracket_generation = Editor->Editor_Highlighter->bracketTree()->generation();
+    QRect viewport_rect = Editor->viewport()->rect();
+    for (QTextBlock block = Editor->firstVisibleBlock(); block.isValid(); block = block.next()) {
+        MySQLBlockData *block_data = reinterpret_cast<MySQLBlockData*>(block.userData());
+        if (block_data) block_data->Fold_Generation = bracket_generation - 1;
+        if (Editor->blockBoundingGeometry(block).translated(Editor->contentOffset()).top() > viewport_rect.bottom())
+            break;
+    }
+}
+
+void
+Bench_Editor::record ( const QString &benchmark,
+                       const Bench_Timing &timing,
+                       int calls_per_iteration,
+                       bool whole_document ) {
+    if (timing.Iterations == 0) return;
+
+    double nsecs_per_iteration = double(timing.Nsecs) / timing.Iterations;
+    QJsonObject result;
+    result["benchmark"] = benchmark;
+    if (QTest::currentDataTag()) {
+        result["corpus"] = Bench_Corpus::kindName(Loaded_Kind);
+        result["lines"] = Loaded_Lines;
+        result["characters"] = Loaded_Characters;
+    }
+    result["iterations"] = timing.Iterations;
+    result["nsecs_per_iteration"] = nsecs_per_iteration;
+    result["calls_per_iteration"] = calls_per_iteration;
+    if (calls_per_iteration > 0) result["nsecs_per_call"] = nsecs_per_iteration / calls_per_iteration;
+    if (whole_document and (nsecs_per_iteration > 0))
+        result["characters_per_second"] = (Loaded_Characters * 1e9) / nsecs_per_iteration;
+    Results.append(result);
+}
+
+void
+Bench_Editor::constructEditor ( ) {
+    // Every further editor, as when opening many tabs, and what each ...
+    // ... adds to the resident set
+    Bench_Timing timing;
+    QBENCHMARK {
+        timing.start();
+        MySQL_Editor editor;
+        timing.stop();
+    }
+    record("MySQL_Editor", timing, 1);
+
+    QList<MySQL_Editor *> editors;
+    QCoreApplication::processEvents();
+    qint64 resident_bytes = Resident_Bytes();
+    for (int instance = 0; instance < Bench_Editor_Instances; instance += 1) editors << new MySQL_Editor();
+    QCoreApplication::processEvents();
+    qint64 instances_resident_bytes = Resident_Bytes() - resident_bytes;
+    qDeleteAll(editors);
+    if (resident_bytes < 0) QSKIP("No resident set size on this platform");
+
+    QJsonObject result;
+    result["benchmark"] = QString("MySQL_Editor.memory");
+    result["instances"] = Bench_Editor_Instances;
+    result["bytes_per_instance"] = double(instances_resident_bytes) / Bench_Editor_Instances;
+    Results.append(result);
+}
+
+void
+Bench_Editor::highlightBlock_data ( ) {
+    corpusData();
+}
+
+void
+Bench_Editor::highlightBlock ( ) {
+    // Every block through highlightBlock, as on load
+    loadCorpus();
+    MySQL_Editor_Highlighter *highlighter = Editor->Editor_Highlighter;
+    Bench_Timing timing;
+    QBENCHMARK {
+        timing.start();
+        highlighter->rehighlight();
+        timing.stop();
+    }
+    record("highlightBlock", timing, Editor->blockCount(), true);
+}
+
+void
+Bench_Editor::bracketMatchPosition_data ( ) {
+    corpusData();
+}
+
+void
+Bench_Editor::bracketMatchPosition ( ) {
+    // Brackets all over the document, IN lists match many lines away
+    loadCorpus();
+    QList<int> positions = samplePositions("()");
+    Bench_Timing timing;
+    QBENCHMARK {
+        timing.start();
+        foreach (int position, positions) Editor->Bracket_Match_Position(position);
+        timing.stop();
+    }
+    record("Bracket_Match_Position", timing, positions.count());
+}
+
+void
+Bench_Editor::computeCurrentParenIndent_data ( ) {
+    corpusData();
+}
+
+void
+Bench_Editor::computeCurrentParenIndent ( ) {
+    // As on Return anywhere in the document
+    loadCorpus();
+    QList<int> positions = samplePositions(QString());
+    Bench_Timing timing;
+    QBENCHMARK {
+        timing.start();
+        foreach (int position, positions) Editor->Compute_Current_Paren_Indent(position);
+        timing.stop();
+    }
+    record("Compute_Current_Paren_Indent", timing, positions.count());
+}
+
+void
+Bench_Editor::uppercaseSqlKeywords_data ( ) {
+    corpusData();
+}
+
+void
+Bench_Editor::uppercaseSqlKeywords ( ) {
+    // The bounded pass after editing a line, on lines all over the document. ...
+    // ... Only the first iteration has keywords left to uppercase.
+    loadCorpus();
+    QList<int> positions;
+    int step = qMax(1, Editor->blockCount() / 100);
+    for (int block_number = 0; block_number < Editor->blockCount(); block_number += step)
+        positions << Editor->document()->findBlockByNumber(block_number).position();
+    Bench_Timing timing;
+    QBENCHMARK {
+        timing.start();
+        foreach (int position, positions)
+            Editor->Uppercase_SQL_Keywords(position, qMax(1, Editor->document()->findBlock(position).length() - 1));
+        timing.stop();
+    }
+    record("Uppercase_SQL_Keywords", timing, positions.count());
+    Loaded_Name.clear();
+}
+
+void
+Bench_Editor::uppercaseSqlKeywordsDocument_data ( ) {
+    corpusData();
+}
+
+void
+Bench_Editor::uppercaseSqlKeywordsDocument ( ) {
+    // The whole document, once, a second pass would find nothing to edit
+    loadCorpus();
+    Bench_Timing timing;
+    QBENCHMARK_ONCE {
+        timing.start();
+        Editor->Uppercase_SQL_Keywords(0, 0);
+        timing.stop();
+    }
+    record("Uppercase_SQL_Keywords.document", timing, 1, true);
+    Loaded_Name.clear();
+}
+
+void
+Bench_Editor::simpleFormatSql_data ( ) {
+    corpusData();
+}
+
+void
+Bench_Editor::simpleFormatSql ( ) {
+    // Once, formatted text formats differently
+    loadCorpus();
+    Bench_Timing timing;
+    QBENCHMARK_ONCE {
+        timing.start();
+        Editor->Simple_Format_SQL();
+        timing.stop();
+    }
+    record("Simple_Format_SQL", timing, 1, true);
+    Loaded_Name.clear();
+}
+
+void
+Bench_Editor::updateSidebar_data ( ) {
+    corpusData();
+}
+
+void
+Bench_Editor::updateSidebar ( ) {
+    // Scrolled to the middle, fold markers cached and cold
+    loadCorpus();
+    QTextCursor middle_cursor(Editor->document()->findBlockByNumber(Editor->blockCount() / 2));
+    Editor->setTextCursor(middle_cursor);
+    Editor->centerCursor();
+    QCoreApplication::processEvents();
+
+    Bench_Timing timing;
+    QBENCHMARK {
+        timing.start();
+        Editor->updateSidebar();
+        timing.stop();
+    }
+    record("updateSidebar", timing, 1);
+
+    Bench_Timing cold_timing;
+    for (int iteration = 0; iteration < 20; iteration += 1) {
+        invalidateVisibleFolds();
+        cold_timing.start();
+        Editor->updateSidebar();
+        cold_timing.stop();
+    }
+    record("updateSidebar.cold", cold_timing, 1);
+}
+
+void
+Bench_Editor::initializeAutoComplete_data ( ) {
+    corpusData();
+}
+
+void
+Bench_Editor::initializeAutoComplete ( ) {
+    // Rebuilding the completion model from the keywords and the ...
+    // ... corpus's identifiers, as after the word lists changed
+    loadCorpus();
+    Editor->setAutoCompleteKeywordsEnabled(true);
+    Editor->setAutoCompleteIdentifiersEnabled(true);
+    Editor->setAutoCompleteIdentifierList(Loaded_Identifiers);
+    Bench_Timing timing;
+    QBENCHMARK {
+        Editor->Completion_Model_Stale = true;
+        timing.start();
+        Editor->initializeAutoComplete();
+        timing.stop();
+    }
+    record("initializeAutoComplete", timing, 1);
+}
+
+int
+main ( int argc,
+       char *argv[] ) {
+    // Headless unless told otherwise
+    if (not qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    // -json <file> is ours, the rest is for QtTest
+    QStringList arguments = app.arguments();
+    QString json_file_name = "bench.json";
+    int json_idx = arguments.indexOf("-json");
+    if ((json_idx > 0) and ((json_idx + 1) < arguments.count())) {
+        json_file_name = arguments.at(json_idx + 1);
+        arguments.removeAt(json_idx + 1);
+        arguments.removeAt(json_idx);
+    }
+
+    Bench_Editor bench(json_file_name);
+    return QTest::qExec(&bench, arguments);
+}
+
+#include "tst_bench.moc"
@@ -0,0 +1,7 @@
+# The editor widget, compiled into each test target. Widget based targets ...
+# ... default to the offscreen platform, see their main()
+QT += widgets concurrent testlib
+CONFIG += c++11 testcase
+INCLUDEPATH += $$PWD/..
+HEADERS += $$PWD/../MySQL_Editor.h
+SOURCES += $$PWD/../MySQL_Editor.cpp
@@ -0,0 +1,3 @@
+TARGET = tst_find
+include(../editor.pri)
+SOURCES += tst_find.cpp
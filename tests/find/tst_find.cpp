@@ -0,0 +1,140 @@
+// findAll and replaceAll on a small document, on the offscreen platform ...
+// ... unless told otherwise. Matches are checked as line:column:length, ...
+// ... on the first line and later ones, plain and regular expression, ...
+// ... with and without skipping strings and comments.
+
+#include "MySQL_Editor.h"
+
+#include <QApplication>
+#include <QtTest>
+
+#define Find_Timeout_Msecs 10000
+
+static const char *Find_Text =
+  "select c_1 from t_1;\n"
+  "select c_1, 'c_1' from t_2; -- c_1\n"
+  "/* c_1 */ select c_12 from t_3;\n"
+  "select C_1";
+
+class Test_Find : public QObject {
+    Q_OBJECT
+
+private slots:
+    void
+    findAll_data ( );
+
+    void
+    findAll ( );
+
+    void
+    replaceAll_data ( );
+
+    void
+    replaceAll ( );
+
+private:
+    QStringList
+    matchList ( const MySQL_Editor &editor );
+};
+
+QStringList
+Test_Find::matchList ( const MySQL_Editor &editor ) {
+    QStringList match_list;
+    foreach (const MySQL_Find_Match &match, editor.findResult().Matches) {
+        int column = match.position - editor.document()->findBlockByNumber(match.line).position();
+        match_list << QString("%1:%2:%3").arg(match.line).arg(column).arg(match.length);
+    }
+    return match_list;
+}
+
+void
+Test_Find::findAll_data ( ) {
+    QTest::addColumn<QString>("pattern");
+    QTest::addColumn<bool>("regular_expression");
+    QTest::addColumn<bool>("skip_strings_and_comments");
+    QTest::addColumn<QStringList>("expected");
+
+    QTest::newRow("plain") << QString("c_1") << false << false
+                           << (QStringList() << "0:7:3" << "1:7:3" << "1:13:3" << "1:31:3"
+                                             << "2:3:3" << "2:17:3" << "3:7:3");
+    QTest::newRow("plain, skipping strings and comments") << QString("c_1") << false << true
+                           << (QStringList() << "0:7:3" << "1:7:3" << "2:17:3" << "3:7:3");
+    QTest::newRow("regex") << QString("c_\\d+") << true << false
+                           << (QStringList() << "0:7:3" << "1:7:3" << "1:13:3" << "1:31:3"
+                                             << "2:3:3" << "2:17:4" << "3:7:3");
+    QTest::newRow("regex, skipping strings and comments") << QString("c_\\d+") << true << true
+                           << (QStringList() << "0:7:3" << "1:7:3" << "2:17:4" << "3:7:3");
+    // Anchors are those of the line
+    QTest::newRow("regex anchored") << QString("^select") << true << false
+                           << (QStringList() << "0:0:6" << "1:0:6" << "3:0:6");
+}
+
+void
+Test_Find::findAll ( ) {
+    QFETCH(QString, pattern);
+    QFETCH(bool, regular_expression);
+    QFETCH(bool, skip_strings_and_comments);
+    QFETCH(QStringList, expected);
+
+    MySQL_Editor editor;
+    editor.setPlainText(Find_Text);
+    QSignalSpy find_spy(&editor, SIGNAL(findFinished(int)));
+    editor.findAll(pattern, regular_expression, Qt::CaseInsensitive, skip_strings_and_comments);
+    QVERIFY(find_spy.wait(Find_Timeout_Msecs));
+    QCOMPARE(find_spy.at(0).at(0).toInt(), expected.count());
+    QCOMPARE(matchList(editor), expected);
+}
+
+void
+Test_Find::replaceAll_data ( ) {
+    QTest::addColumn<bool>("skip_strings_and_comments");
+    QTest::addColumn<int>("replace_count");
+    QTest::addColumn<QString>("expected");
+
+    QTest::newRow("regex") << false << 7
+                           << QString("select col_1 from t_1;\n"
+                                      "select col_1, 'col_1' from t_2; -- col_1\n"
+                                      "/* col_1 */ select col_12 from t_3;\n"
+                                      "select col_1");
+    QTest::newRow("regex, skipping strings and comments") << true << 4
+                           << QString("select col_1 from t_1;\n"
+                                      "select col_1, 'c_1' from t_2; -- c_1\n"
+                                      "/* c_1 */ select col_12 from t_3;\n"
+                                      "select col_1");
+}
+
+void
+Test_Find::replaceAll ( ) {
+    QFETCH(bool, skip_strings_and_comments);
+    QFETCH(int, replace_count);
+    QFETCH(QString, expected);
+
+    MySQL_Editor editor;
+    editor.setPlainText(Find_Text);
+    QSignalSpy find_spy(&editor, SIGNAL(findFinished(int)));
+    editor.findAll("c_(\\d+)", true, Qt::CaseInsensitive, skip_strings_and_comments);
+    QVERIFY(find_spy.wait(Find_Timeout_Msecs));
+
+    QSignalSpy replace_spy(&editor, SIGNAL(replaceFinished(int)));
+    editor.replaceAll("col_\\1");
+    QVERIFY(replace_spy.wait(Find_Timeout_Msecs));
+    QCOMPARE(replace_spy.at(0).at(0).toInt(), replace_count);
+    QCOMPARE(editor.toPlainText(), expected);
+
+    // One undo step
+    editor.undo();
+    QCOMPARE(editor.toPlainText(), QString(Find_Text));
+}
+
+int
+main ( int argc,
+       char *argv[] ) {
+    // Headless unless told otherwise
+    if (not qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    Test_Find find;
+    return QTest::qExec(&find, argc, argv);
+}
+
+#include "tst_find.moc"
@@ -0,0 +1,11 @@
+# Keystroke replay against baseline.json, left out of make check until ...
+# ... the baseline holds measurements rather than budgets, e.g.
+#   ./tst_replay
+#   ./tst_replay -record baseline.json
+TARGET = tst_replay
+include(../editor.pri)
+CONFIG -= testcase
+INCLUDEPATH += $$PWD/../bench
+HEADERS += $$PWD/../bench/bench_corpus.h
+SOURCES += $$PWD/../bench/bench_corpus.cpp tst_replay.cpp
+DEFINES += REPLAY_BASELINE=\\\"$$PWD/baseline.json\\\"
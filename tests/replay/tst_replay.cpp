@@ -0,0 +1,295 @@
+// Keystroke replay: traces of typing are sent key by key to an editor ...
+// ... holding a stored procedure corpus, on the offscreen platform unless ...
+// ... told otherwise. The latency of every key, its events processed, ...
+// ... gives p50, p99 and max per trace, which fail when above the stored ...
+// ... baseline times its tolerance. -baseline <file> replays against ...
+// ... another baseline, -record <file> writes the latencies measured as one.
+
+#include "MySQL_Editor.h"
+#include "bench_corpus.h"
+
+#include <QApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QtTest>
+
+#include <algorithm>
+#include <cmath>
+
+// Below the deferred highlighting threshold, lexed as it is set
+#define Replay_Corpus_Lines 5000
+#define Replay_Default_Tolerance 2.0
+
+struct Replay_Key {
+    // A character typed as such, or else Key with Modifiers
+    char Character;
+    Qt::Key Key;
+    Qt::KeyboardModifiers Modifiers;
+};
+
+typedef QList<Replay_Key> Replay_Trace;
+
+static void
+Append_Text ( Replay_Trace &trace,
+              const QString &text ) {
+    QByteArray characters = text.toLatin1();
+    for (int character_idx = 0; character_idx < characters.length(); character_idx += 1) {
+        Replay_Key key = { characters.at(character_idx), Qt::Key_unknown, Qt::NoModifier };
+        trace << key;
+    }
+}
+
+static void
+Append_Key ( Replay_Trace &trace,
+             Qt::Key key_code,
+             Qt::KeyboardModifiers modifiers = Qt::NoModifier ) {
+    Replay_Key key = { 0, key_code, modifiers };
+    trace << key;
+}
+
+static Replay_Trace
+Build_Trace ( const QString &trace_name ) {
+    Replay_Trace trace;
+    if (trace_name == "long_query") {
+        // One long line, the '.'s pop up and close context completion
+        Append_Text(trace, "select t_1.c_1, t_1.c_2, count(*) as row_count, sum(t_2.c_3) "
+                           "from t_1 join t_2 on (t_1.id = t_2.c_4) "
+                           "where t_1.c_5 in (1, 2, 3, 5, 8, 13) and (t_2.c_6 like 'a%' or t_2.c_7 is null) "
+                           "group by t_1.c_1, t_1.c_2 having count(*) > 1 "
+                           "order by row_count desc limit 100;");
+    }
+    else if (trace_name == "return_auto_indent") {
+        // Return inside open parens indents to the innermost one
+        for (int repeat = 0; repeat < 8; repeat += 1) {
+            Append_Text(trace, "select *");
+            Append_Key(trace, Qt::Key_Return);
+            Append_Text(trace, "from t_1");
+            Append_Key(trace, Qt::Key_Return);
+            Append_Text(trace, "where ((c_1 like 'a%') or");
+            Append_Key(trace, Qt::Key_Return);
+            Append_Text(trace, "(c_2 = 1 and");
+            Append_Key(trace, Qt::Key_Return);
+            Append_Text(trace, "c_3 in (1, 2,");
+            Append_Key(trace, Qt::Key_Return);
+            Append_Text(trace, "3, 4)));");
+            Append_Key(trace, Qt::Key_Return);
+        }
+    }
+    else if (trace_name == "intelligent_tabbing") {
+        // Tab to the next word boundary of the line above, Escape back
+        for (int repeat = 0; repeat < 10; repeat += 1) {
+            Append_Text(trace, "select");
+            Append_Key(trace, Qt::Key_Tab);
+            Append_Text(trace, "c_1,");
+            Append_Key(trace, Qt::Key_Return);
+            Append_Key(trace, Qt::Key_Tab);
+            Append_Key(trace, Qt::Key_Tab);
+            Append_Text(trace, "c_2");
+            Append_Key(trace, Qt::Key_Escape);
+            Append_Key(trace, Qt::Key_Escape);
+            Append_Key(trace, Qt::Key_Return);
+            Append_Text(trace, "from t_2;");
+            Append_Key(trace, Qt::Key_Return);
+        }
+    }
+    else if (trace_name == "context_completion") {
+        // '.' after a table name pops up its columns
+        Append_Text(trace, "select ");
+        for (int repeat = 0; repeat < 20; repeat += 1)
+            Append_Text(trace, QString("t_%1.c_%2, ").arg(repeat % 4).arg(repeat));
+        Append_Text(trace, "1 from t_0;");
+    }
+    else if (trace_name == "format") {
+        // Ctrl+= formats the whole document
+        for (int repeat = 0; repeat < 5; repeat += 1) {
+            Append_Text(trace, "select c_1, c_2 from t_1 where c_3 = 1 and c_4 in (select c_5 from t_2);");
+            Append_Key(trace, Qt::Key_Equal, Qt::ControlModifier);
+            Append_Key(trace, Qt::Key_Return);
+        }
+    }
+    return trace;
+}
+
+static qint64
+Percentile ( const QVector<qint64> &sorted_latencies,
+             int percent ) {
+    // Nearest rank
+    if (sorted_latencies.isEmpty()) return 0;
+    int rank = int(std::ceil((percent / 100.0) * sorted_latencies.count()));
+    return sorted_latencies.at(qBound(0, rank - 1, sorted_latencies.count() - 1));
+}
+
+class Test_Replay : public QObject {
+    Q_OBJECT
+
+public:
+    Test_Replay ( const QString &baseline_file_name,
+                  const QString &record_file_name );
+
+private slots:
+    void
+    initTestCase ( );
+
+    void
+    cleanupTestCase ( );
+
+    void
+    replay_data ( );
+
+    void
+    replay ( );
+
+private:
+    QString Baseline_File_Name;
+    QString Record_File_Name;
+    QJsonObject Baseline_Traces;
+    double Tolerance;
+    QJsonObject Measured_Traces;
+
+    QString Corpus;
+    QStringList Identifiers;
+    QHash <QString, QStringList> Context_Identifiers;
+};
+
+Test_Replay::Test_Replay ( const QString &baseline_file_name,
+                           const QString &record_file_name ) : Baseline_File_Name ( baseline_file_name ),
+                                                               Record_File_Name ( record_file_name ),
+                                                               Tolerance ( Replay_Default_Tolerance ) {
+}
+
+void
+Test_Replay::initTestCase ( ) {
+    QFile baseline_file(Baseline_File_Name);
+    if (baseline_file.open(QIODevice::ReadOnly)) {
+        QJsonParseError parse_error;
+        QJsonDocument baseline = QJsonDocument::fromJson(baseline_file.readAll(), &parse_error);
+        QVERIFY2(baseline.isObject(), qPrintable(parse_error.errorString()));
+        Baseline_Traces = baseline.object().value("traces").toObject();
+        Tolerance = baseline.object().value("tolerance").toDouble(Replay_Default_Tolerance);
+    }
+    else if (Record_File_Name.isEmpty()) {
+        QFAIL(qPrintable(QString("No baseline %1, record one with -record").arg(Baseline_File_Name)));
+    }
+
+    Corpus = Bench_Corpus::generate(Bench_Corpus::Stored_Procedures, Replay_Corpus_Lines, &Identifiers);
+    QStringList columns;
+    foreach (const QString &identifier, Identifiers)
+        if (identifier.startsWith("c_")) columns << identifier;
+    foreach (const QString &identifier, Identifiers)
+        if (identifier.startsWith("t_")) Context_Identifiers[identifier] = columns;
+}
+
+void
+Test_Replay::cleanupTestCase ( ) {
+    if (Record_File_Name.isEmpty()) return;
+
+    QJsonObject root;
+    root["note"] = QString("Per-key latencies in microseconds, recorded with Qt %1 on %2")
+                   .arg(qVersion()).arg(QGuiApplication::platformName());
+    root["tolerance"] = Tolerance;
+    root["traces"] = Measured_Traces;
+    QFile record_file(Record_File_Name);
+    QVERIFY2(record_file.open(QIODevice::WriteOnly | QIODevice::Truncate), qPrintable(record_file.errorString()));
+    record_file.write(QJsonDocument(root).toJson());
+}
+
+void
+Test_Replay::replay_data ( ) {
+    QTest::addColumn<QString>("trace_name");
+
+    QTest::newRow("long_query") << QString("long_query");
+    QTest::newRow("return_auto_indent") << QString("return_auto_indent");
+    QTest::newRow("intelligent_tabbing") << QString("intelligent_tabbing");
+    QTest::newRow("context_completion") << QString("context_completion");
+    QTest::newRow("format") << QString("format");
+}
+
+void
+Test_Replay::replay ( ) {
+    QFETCH(QString, trace_name);
+    Replay_Trace trace = Build_Trace(trace_name);
+    QVERIFY(not trace.isEmpty());
+
+    MySQL_Editor editor;
+    editor.setAutoIndentEnabled(true);
+    editor.setAutoUppercaseKeywordsEnabled(true);
+    editor.setAutoCompleteKeywordsEnabled(true);
+    editor.setAutoCompleteIdentifiersEnabled(true);
+    editor.setAutoCompleteIdentifierList(Identifiers);
+    editor.setAutoCompleteContextIdentifierList(Context_Identifiers);
+    editor.resize(1000, 800);
+    editor.show();
+    QVERIFY(QTest::qWaitForWindowExposed(&editor));
+
+    // The first pass warms up, the second is measured
+    QVector<qint64> latencies;
+    QElapsedTimer timer;
+    for (int pass = 0; pass < 2; pass += 1) {
+        editor.setPlainText(Corpus + "\n\n");
+        editor.moveCursor(QTextCursor::End);
+        QCoreApplication::processEvents();
+
+        latencies.clear();
+        foreach (const Replay_Key &key, trace) {
+            timer.start();
+            if (key.Character) QTest::keyClick(&editor, key.Character, key.Modifiers);
+            else QTest::keyClick(&editor, key.Key, key.Modifiers);
+            QCoreApplication::processEvents();
+            latencies << timer.nsecsElapsed();
+        }
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    QJsonObject measured;
+    measured["keys"] = latencies.count();
+    measured["p50_usecs"] = double(Percentile(latencies, 50) / 1000);
+    measured["p99_usecs"] = double(Percentile(latencies, 99) / 1000);
+    measured["max_usecs"] = double(latencies.last() / 1000);
+    Measured_Traces[trace_name] = measured;
+    qInfo("%s: %d keys, p50 %.0f us, p99 %.0f us, max %.0f us",
+          qPrintable(trace_name), latencies.count(),
+          measured["p50_usecs"].toDouble(), measured["p99_usecs"].toDouble(), measured["max_usecs"].toDouble());
+
+    if (not Baseline_Traces.contains(trace_name))
+        QSKIP("No baseline for this trace, record one with -record");
+    QJsonObject baseline = Baseline_Traces.value(trace_name).toObject();
+    const char *metrics[] = { "p50_usecs", "p99_usecs", "max_usecs" };
+    for (uint metric_idx = 0; metric_idx < (sizeof(metrics) / sizeof(metrics[0])); metric_idx += 1) {
+        QString metric = metrics[metric_idx];
+        double threshold = baseline.value(metric).toDouble() * Tolerance;
+        QVERIFY2(measured.value(metric).toDouble() <= threshold,
+                 qPrintable(QString("%1 %2 us, over %3 us (baseline %4 us times %5)")
+                            .arg(metric).arg(measured.value(metric).toDouble())
+                            .arg(threshold).arg(baseline.value(metric).toDouble()).arg(Tolerance)));
+    }
+}
+
+int
+main ( int argc,
+       char *argv[] ) {
+    // Headless unless told otherwise
+    if (not qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    // -baseline <file> and -record <file> are ours, the rest is for QtTest
+    QStringList arguments = app.arguments();
+    QString baseline_file_name = REPLAY_BASELINE;
+    QString record_file_name;
+    int option_idx = arguments.indexOf("-baseline");
+    if ((option_idx > 0) and ((option_idx + 1) < arguments.count())) {
+        baseline_file_name = arguments.at(option_idx + 1);
+        arguments.removeAt(option_idx + 1);
+        arguments.removeAt(option_idx);
+    }
+    option_idx = arguments.indexOf("-record");
+    if ((option_idx > 0) and ((option_idx + 1) < arguments.count())) {
+        record_file_name = arguments.at(option_idx + 1);
+        arguments.removeAt(option_idx + 1);
+        arguments.removeAt(option_idx);
+    }
+
+    Test_Replay replay(baseline_file_name, record_file_name);
+    return QTest::qExec(&replay, arguments);
+}
+
+#include "tst_replay.moc"
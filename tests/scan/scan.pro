@@ -0,0 +1,3 @@
+TARGET = tst_scan
+include(../editor.pri)
+SOURCES += tst_scan.cpp
@@ -0,0 +1,137 @@
+// Differential test of the lexer's UTF-16 scan kernels. Every vector ...
+// ... kernel the CPU supports must agree with the scalar loop, at and ...
+// ... around vector boundaries, from unaligned starts and on random text.
+
+#include "MySQL_Editor.h"
+
+#include <QtTest>
+
+class Test_Scan : public QObject {
+    Q_OBJECT
+
+private slots:
+    void
+    initTestCase ( );
+
+    void
+    vectorBoundaries ( );
+
+    void
+    randomText ( );
+
+private:
+    bool
+    agrees ( const QVector<ushort> &text,
+             int from,
+             int to,
+             ushort c0,
+             ushort c1,
+             ushort c2,
+             ushort c3 );
+
+    QVector<Scan_Function> Kernels;
+    QStringList Kernel_Names;
+};
+
+void
+Test_Scan::initTestCase ( ) {
+#if defined(MYSQL_EDITOR_SIMD_SCAN)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        Kernels << Scan_For_Characters_SSE2;
+        Kernel_Names << "SSE2";
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        Kernels << Scan_For_Characters_AVX2;
+        Kernel_Names << "AVX2";
+    }
+#endif
+    if (Kernels.isEmpty()) QSKIP("No vector kernel for this CPU or compiler");
+}
+
+bool
+Test_Scan::agrees ( const QVector<ushort> &text,
+                    int from,
+                    int to,
+                    ushort c0,
+                    ushort c1,
+                    ushort c2,
+                    ushort c3 ) {
+    int expected_idx = Scan_For_Characters_Scalar(text.constData(), from, to, c0, c1, c2, c3);
+    for (int kernel_idx = 0; kernel_idx < Kernels.count(); kernel_idx += 1) {
+        int found_idx = Kernels.at(kernel_idx)(text.constData(), from, to, c0, c1, c2, c3);
+        if (not (found_idx == expected_idx)) {
+            qWarning("%s found %d, scalar %d, in [%d, %d) of %d code units",
+                     qPrintable(Kernel_Names.at(kernel_idx)), found_idx, expected_idx, from, to, text.count());
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+Test_Scan::vectorBoundaries ( ) {
+    // Lengths on either side of 8 (SSE2) and 16 (AVX2) code unit multiples, ...
+    // ... from starts misaligning the loads, with no needle, or one needle ...
+    // ... at every position (the last one included), each of c0 .. c3 in turn
+    const int lengths[] = { 0, 1, 7, 8, 9, 15, 16, 17, 23, 24, 25, 31, 32, 33, 47, 48, 49, 63, 64, 65 };
+    const ushort needles[] = { '\'', '\\', '*', '\n' };
+    // Same low byte as a needle, caught only by 16 bit compares
+    const ushort filler = 0x2A00 | '\'';
+
+    for (uint length_idx = 0; length_idx < (sizeof(lengths) / sizeof(lengths[0])); length_idx += 1) {
+        int length = lengths[length_idx];
+        for (int from = 0; from < 4; from += 1) {
+            QVector<ushort> text(from + length, filler);
+            QVERIFY(agrees(text, from, from + length, needles[0], needles[1], needles[2], needles[3]));
+            for (int needle_idx = 0; needle_idx < length; needle_idx += 1) {
+                text[from + needle_idx] = needles[needle_idx % 4];
+                QVERIFY(agrees(text, from, from + length, needles[0], needles[1], needles[2], needles[3]));
+                // A second needle after the first must not be reported instead
+                if ((needle_idx + 1) < length) {
+                    text[from + length - 1] = needles[(needle_idx + 1) % 4];
+                    QVERIFY(agrees(text, from, from + length, needles[0], needles[1], needles[2], needles[3]));
+                    text[from + length - 1] = filler;
+                }
+                text[from + needle_idx] = filler;
+            }
+        }
+    }
+
+    // Empty ranges, as well as from == to inside text
+    QVector<ushort> text(40, 'a');
+    QVERIFY(agrees(QVector<ushort>(), 0, 0, 'a', 'a', 'a', 'a'));
+    QVERIFY(agrees(text, 17, 17, 'a', 'a', 'a', 'a'));
+    // Repeated needles, as the lexer passes for a single character
+    text[33] = '`';
+    QVERIFY(agrees(text, 1, 40, '`', '`', '`', '`'));
+}
+
+void
+Test_Scan::randomText ( ) {
+    // Seeded, so that a failure can be replayed
+    quint32 random_state = 20261016u;
+    for (int round = 0; round < 20000; round += 1) {
+        random_state = (random_state * 1664525u) + 1013904223u;
+        int length = int(random_state >> 24);
+        // Small alphabets find needles often, large ones rarely
+        ushort alphabet = ((round % 2) == 0) ? 8 : 0xFFFF;
+        QVector<ushort> text(length);
+        for (int ch_idx = 0; ch_idx < length; ch_idx += 1) {
+            random_state = (random_state * 1664525u) + 1013904223u;
+            text[ch_idx] = ushort((random_state >> 8) % alphabet);
+        }
+        random_state = (random_state * 1664525u) + 1013904223u;
+        int from = (length > 0) ? int((random_state >> 8) % uint(length)) : 0;
+        random_state = (random_state * 1664525u) + 1013904223u;
+        int to = from + ((length > from) ? int((random_state >> 8) % uint(length - from + 1)) : 0);
+        random_state = (random_state * 1664525u) + 1013904223u;
+        ushort c0 = ushort(random_state % alphabet);
+        ushort c1 = ushort((random_state >> 16) % alphabet);
+        QVERIFY(agrees(text, from, to, c0, c1, c0, 0));
+    }
+}
+
+QTEST_APPLESS_MAIN(Test_Scan)
+
+#include "tst_scan.moc"
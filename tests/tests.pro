@@ -0,0 +1,5 @@
+# Headless tests and benchmarks, e.g.
+#   qmake tests.pro && make && make check
+# Widget based targets run on the offscreen platform unless told otherwise
+TEMPLATE = subdirs
+SUBDIRS = scan find bench replay